@@ -2,11 +2,16 @@
 
 #include <sem/types.h>
 
+#include <parse/location.hh>
+
 #include <utils/undefined.h>
 #include <utils/fmap.h>
 #include <utils/top.h>
 #include <utils/string.h>
 
+#include <cctype>
+#include <set>
+
 namespace codegen
 {
 
@@ -268,49 +273,47 @@ std::list<Variable> function_variables(const ast::FuncDefinition & func)
 
 namespace
 {
-void insert_statements(const ast::VarDeclaration & st, std::list<Statement> & entries) { }
+void insert_statements(const ast::VarDeclaration & st, std::list<Statement> & entries, std::size_t & label_idx) { }
 
-void insert_statements(const ast::Assignment & st, std::list<Statement> & entries)
+void insert_statements(const ast::Assignment & st, std::list<Statement> & entries, std::size_t & label_idx)
 {
     entries.push_back(Statement(st));
 }
 
-void insert_statements(const ast::Write & st, std::list<Statement> & entries)
+void insert_statements(const ast::Write & st, std::list<Statement> & entries, std::size_t & label_idx)
 {
     entries.push_back(Statement(st));
 }
 
-void insert_statements(const ast::Return & st, std::list<Statement> & entries)
+void insert_statements(const ast::Return & st, std::list<Statement> & entries, std::size_t & label_idx)
 {
     entries.push_back(Statement(st));
 }
 
-void insert_statements(const ast::Block & st, std::list<Statement> & entries);
+void insert_statements(const ast::Block & st, std::list<Statement> & entries, std::size_t & label_idx);
 
-void insert_statements(const ast::If & st, std::list<Statement> & entries)
+void insert_statements(const ast::If & st, std::list<Statement> & entries, std::size_t & label_idx)
 {
     std::list<Statement> thenBody, elseBody;
-    insert_statements(*st.thenBody, thenBody);
-    insert_statements(*st.elseBody, elseBody);
+    insert_statements(*st.thenBody, thenBody, label_idx);
+    insert_statements(*st.elseBody, elseBody, label_idx);
     If gen_st{st.loc, st.condition, thenBody, elseBody};
     entries.push_back(Statement(gen_st));
 }
 
-void insert_statements(const ast::While & st, std::list<Statement> & entries)
+void insert_statements(const ast::While & st, std::list<Statement> & entries, std::size_t & label_idx)
 {
     std::list<Statement> body;
-    insert_statements(*st.body, body);
-    static std::size_t label_idx = 0;
-    std::string label = "label_" + label_idx;
-    label_idx += 1;
+    insert_statements(*st.body, body, label_idx);
+    std::string label = "label_" + std::to_string(label_idx++);
     While gen_st{st.loc, label, st.condition, body};
     entries.push_back(Statement(gen_st));
 }
 
-void insert_statements(const ast::Block & st, std::list<Statement> & entries)
+void insert_statements(const ast::Block & st, std::list<Statement> & entries, std::size_t & label_idx)
 {
     for (auto statement : st.statements)
-        fmap([&entries], x, insert_statements(x, entries), statement.statement);
+        fmap([&], x, insert_statements(x, entries, label_idx), statement.statement);
 }
 }
 
@@ -318,7 +321,9 @@ std::list<Statement> function_statements(const ast::FuncDefinition & func)
 {
     std::list<Statement> statements;
 
-    insert_statements(func.statements, statements);
+    /* Labels are numbered per function so that the output only depends on the function itself */
+    std::size_t label_idx = 0;
+    insert_statements(func.statements, statements, label_idx);
 
     return statements;
 }
@@ -375,4 +380,95 @@ std::string to_string(const If & code)
         + "}\n";
 }
 
+std::string to_string(const Effects & effects)
+{
+    std::string result;
+    if (effects.reads_memory)
+        result += " reads";
+    if (effects.writes_memory)
+        result += " writes";
+    if (effects.io)
+        result += " io";
+    if (effects.recursive)
+        result += " recursive";
+    return "effects {" + result + " }";
+}
+
+namespace
+{
+std::string to_string(const std::shared_ptr<ast::location> & loc)
+{
+    if (!loc)
+        return " -";
+    return " " + std::to_string(loc->begin.line) + "." + std::to_string(loc->begin.column);
+}
+
+std::string statement_locations(const std::list<Statement> & statements)
+{
+    std::string result;
+    for (const auto & st : statements)
+    {
+        result += to_string(st.loc);
+        const If * if_st = boost::get<If>(&st.statement);
+        const While * while_st = boost::get<While>(&st.statement);
+        if (if_st)
+            result += " {" + statement_locations(if_st->thenBody) + " }"
+                + " {" + statement_locations(if_st->elseBody) + " }";
+        if (while_st)
+            result += " {" + statement_locations(while_st->body) + " }";
+    }
+    return result;
+}
+}
+
+std::string fingerprint(const Code & code, const Function & function, bool locations)
+{
+    std::string body = to_string(function);
+
+    /*
+     * Local names are annotated with their types, so any identifier
+     * in the body that names a top-level entry refers to that entry.
+     */
+    std::set<std::string> identifiers;
+    for (auto it = body.begin(); it != body.end(); )
+    {
+        if (!std::isalpha(*it) && *it != '_')
+        {
+            ++it;
+            continue;
+        }
+        auto begin = it;
+        while (it != body.end() && (std::isalnum(*it) || *it == '_'))
+            ++it;
+        identifiers.insert(std::string(begin, it));
+    }
+
+    /* Effects become attributes of the function and of declarations of its callees */
+    std::string result = body + "\n" + to_string(function.effects);
+    if (function.memoise)
+        result += "\nmemoise";
+    if (locations)
+    {
+        result += "\nlocations" + to_string(function.loc) + "\n";
+        for (const auto & arg : function.arguments)
+            result += to_string(arg.loc);
+        for (const auto & var : function.variables)
+            result += to_string(var.loc);
+        result += "\n" + statement_locations(function.statements);
+    }
+    for (const auto & entry : code.entries)
+    {
+        const Variable * var = boost::get<Variable>(&entry.entry);
+        if (var && identifiers.count(var->name))
+            result += "\n" + ast::to_string(*var);
+
+        const Function * func = boost::get<Function>(&entry.entry);
+        if (func && identifiers.count(func->name))
+            result += "\n" + ast::to_string(func->type) + " " + func->name + "("
+                + utils::to_string(func->arguments.begin(), func->arguments.end(), ", ") + ") "
+                + to_string(func->effects);
+    }
+    return result;
+}
+
 }
@@ -54,6 +54,29 @@ struct Statement
 
 using Variable = ast::VarDeclaration;
 
+/*
+ * What a call of a function may do, computed by optimise::analyse_effects.
+ * Until then nothing is known and everything is assumed.
+ */
+struct Effects
+{
+    Effects()
+        : reads_memory(true)
+        , writes_memory(true)
+        , io(true)
+        , recursive(true)
+    {}
+
+    /* Reads global variables or memory through pointers */
+    bool reads_memory;
+    /* Writes global variables or memory through pointers */
+    bool writes_memory;
+    /* Calls read() or write() */
+    bool io;
+    /* May call itself, directly or through other functions */
+    bool recursive;
+};
+
 std::list<Variable> function_variables(const ast::FuncDefinition & func);
 std::list<Statement> function_statements(const ast::FuncDefinition & func);
 
@@ -66,6 +89,7 @@ struct Function
         , arguments(func.declaration.arguments)
         , variables(function_variables(func))
         , statements(function_statements(func))
+        , memoise(false)
     {}
 
     std::shared_ptr<ast::location> loc;
@@ -74,6 +98,9 @@ struct Function
     std::list<Variable> arguments;
     std::list<Variable> variables;
     std::list<Statement> statements;
+    Effects effects;
+    /* Results are kept in memo tables, set by optimise::memoise_functions */
+    bool memoise;
 };
 
 struct CodeEntry
@@ -108,4 +135,11 @@ std::string to_string(const Statement & code);
 std::string to_string(const Continue & code);
 std::string to_string(const While & code);
 std::string to_string(const If & code);
+std::string to_string(const Effects & effects);
+
+/*
+ * Text identifying everything code generation of `function` depends on,
+ * with `locations` also the source locations debug information uses
+ */
+std::string fingerprint(const Code & code, const Function & function, bool locations = false);
 }
@@ -0,0 +1,152 @@
+#include "debug.h"
+
+#include <utils/fmap.h>
+
+#include <llvm/Support/Dwarf.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
+#include <parse/location.hh>
+
+#include <stdexcept>
+#include <vector>
+
+namespace codegen
+{
+namespace
+{
+unsigned line(const std::shared_ptr<ast::location> & loc)
+{
+    return loc ? loc->begin.line : 0;
+}
+
+/* Locals are annotated with their type to tell scopes apart, debuggers show the name from the source */
+std::string source_name(const Variable & var)
+{
+    std::string suffix = "_" + ast::to_string(var.type);
+    if (var.name.size() > suffix.size()
+            && var.name.compare(var.name.size() - suffix.size(), suffix.size(), suffix) == 0)
+        return var.name.substr(0, var.name.size() - suffix.size());
+    return var.name;
+}
+}
+
+debug_info::debug_info(llvm::Module & module, const std::string & source_name)
+    : builder(module)
+    , pointer_size(module.getDataLayout().getPointerSizeInBits())
+    , function(nullptr)
+{
+    llvm::SmallString<128> directory(llvm::sys::path::parent_path(source_name));
+    if (directory.empty() || llvm::sys::path::is_relative(directory))
+    {
+        llvm::SmallString<128> current;
+        if (!llvm::sys::fs::current_path(current))
+        {
+            llvm::sys::path::append(current, directory);
+            directory = current;
+        }
+    }
+    llvm::StringRef file_name = llvm::sys::path::filename(source_name);
+
+    file = builder.createFile(file_name, directory);
+    unit = builder.createCompileUnit(llvm::dwarf::DW_LANG_C, file_name, directory, "lcc", false, "", 0);
+
+    module.addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+    module.addModuleFlag(llvm::Module::Warning, "Dwarf Version", 4);
+}
+
+llvm::DIType * debug_info::gen_type(const ast::AtomType & type)
+{
+    switch (type.type)
+    {
+        case ast::AtomType::BOOL:
+            return builder.createBasicType("bool", 8, 8, llvm::dwarf::DW_ATE_boolean);
+        case ast::AtomType::INT:
+            return builder.createBasicType("int", 64, 64, llvm::dwarf::DW_ATE_signed);
+    }
+
+    throw std::runtime_error("unknown type");
+}
+
+llvm::DIType * debug_info::gen_type(const ast::PointerType & type)
+{
+    return builder.createPointerType(gen_type(*type.type), pointer_size);
+}
+
+llvm::DIType * debug_info::gen_type(const ast::FuncType & type)
+{
+    return gen_subroutine_type(type);
+}
+
+llvm::DIType * debug_info::gen_type(const ast::Type & type)
+{
+    return fmap([this], x, this->gen_type(x), type.type);
+}
+
+llvm::DISubroutineType * debug_info::gen_subroutine_type(const ast::FuncType & type)
+{
+    std::vector<llvm::Metadata *> types = { gen_type(*type.rettype) };
+    for (const auto & argtype : type.argtypes)
+        types.push_back(gen_type(argtype));
+    return builder.createSubroutineType(file, builder.getOrCreateTypeArray(types));
+}
+
+void debug_info::declare_global(const Variable & var, llvm::GlobalVariable * global)
+{
+    builder.createGlobalVariable(unit, var.name, var.name, file, line(var.loc),
+                                 gen_type(var.type), false, global);
+}
+
+void debug_info::begin_function(llvm::IRBuilder<> & ir, const Function & entry, llvm::Function * f)
+{
+    ast::FuncType type{entry.loc, std::make_shared<ast::Type>(entry.type), {}};
+    for (const auto & arg : entry.arguments)
+        type.argtypes.push_back(arg.type);
+
+    unsigned function_line = line(entry.loc);
+    function = builder.createFunction(unit, entry.name, f->getName(), file, function_line,
+                                      gen_subroutine_type(type), false, true, function_line,
+                                      llvm::DINode::FlagPrototyped, false, f);
+    variables.clear();
+    set_location(ir, entry.loc);
+}
+
+void debug_info::end_function(llvm::IRBuilder<> & ir)
+{
+    function = nullptr;
+    ir.SetCurrentDebugLocation(llvm::DebugLoc());
+}
+
+void debug_info::set_location(llvm::IRBuilder<> & ir, const std::shared_ptr<ast::location> & loc)
+{
+    if (loc)
+        ir.SetCurrentDebugLocation(llvm::DebugLoc::get(loc->begin.line, loc->begin.column, function));
+}
+
+void debug_info::declare_variable(llvm::IRBuilder<> & ir, const Variable & var, llvm::Value * storage,
+                                  unsigned arg_no)
+{
+    unsigned tag = arg_no ? llvm::dwarf::DW_TAG_arg_variable : llvm::dwarf::DW_TAG_auto_variable;
+    llvm::DILocalVariable * variable = builder.createLocalVariable(
+            tag, function, source_name(var), file, line(var.loc), gen_type(var.type), true, 0, arg_no);
+    variables[var.name] = variable;
+
+    if (storage)
+        builder.insertDeclare(storage, variable, builder.createExpression(),
+                              ir.getCurrentDebugLocation().get(), ir.GetInsertBlock());
+}
+
+void debug_info::set_value(llvm::IRBuilder<> & ir, const std::string & name, llvm::Value * value)
+{
+    auto it = variables.find(name);
+    if (it == variables.end())
+        return;
+    builder.insertDbgValueIntrinsic(value, 0, it->second, builder.createExpression(),
+                                    ir.getCurrentDebugLocation().get(), ir.GetInsertBlock());
+}
+
+void debug_info::finalize()
+{
+    builder.finalize();
+}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ast/l.h"
+
+#include <llvm/IR/DIBuilder.h>
+#include <llvm/IR/DebugInfoMetadata.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace codegen
+{
+/*
+ * DWARF debug information of one module: a compile unit for the source
+ * file, a subprogram for every function, line locations of statements
+ * and descriptions of variables. Locations are taken from the AST.
+ */
+struct debug_info
+{
+    debug_info(llvm::Module & module, const std::string & source_name);
+
+    debug_info(const debug_info &) = delete;
+    debug_info & operator=(const debug_info &) = delete;
+
+    void declare_global(const Variable & var, llvm::GlobalVariable * global);
+
+    /* Instructions generated until end_function belong to `f` */
+    void begin_function(llvm::IRBuilder<> & builder, const Function & function, llvm::Function * f);
+    void end_function(llvm::IRBuilder<> & builder);
+
+    void set_location(llvm::IRBuilder<> & builder, const std::shared_ptr<ast::location> & loc);
+
+    /*
+     * Describes a local variable or an argument (`arg_no` counts from 1).
+     * A variable kept in memory is given by `storage`, one in SSA form
+     * has no storage and its values are described by set_value.
+     */
+    void declare_variable(llvm::IRBuilder<> & builder, const Variable & var, llvm::Value * storage,
+                          unsigned arg_no = 0);
+    void set_value(llvm::IRBuilder<> & builder, const std::string & name, llvm::Value * value);
+
+    /* Has to be called before the module is verified or emitted */
+    void finalize();
+
+private:
+    llvm::DIType * gen_type(const ast::AtomType & type);
+    llvm::DIType * gen_type(const ast::PointerType & type);
+    llvm::DIType * gen_type(const ast::FuncType & type);
+    llvm::DIType * gen_type(const ast::Type & type);
+    llvm::DISubroutineType * gen_subroutine_type(const ast::FuncType & type);
+
+    llvm::DIBuilder builder;
+    llvm::DIFile * file;
+    llvm::DICompileUnit * unit;
+    unsigned pointer_size;
+    llvm::DISubprogram * function;
+    /* Variables of the current function by their annotated name */
+    std::map<std::string, llvm::DILocalVariable *> variables;
+};
+}
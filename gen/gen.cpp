@@ -4,10 +4,12 @@
 #include <sem/l.h>
 
 #include <utils/undefined.h>
+#include <utils/profiler.h>
 
 #include <llvm/IR/Module.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/GlobalVariable.h>
@@ -15,18 +17,48 @@
 #include <llvm/IR/Verifier.h>
 #include <llvm/IR/TypeBuilder.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Config/llvm-config.h>
 
 #include <boost/variant.hpp>
 
 #include <memory>
+#include <vector>
 #include <map>
 
 namespace
 {
-llvm::IRBuilder<> & get_builder()
+void verify_module(llvm::Module & module)
 {
-    static llvm::IRBuilder<> builder(llvm::getGlobalContext());
-    return builder;
+    if (llvm::verifyModule(module, &llvm::errs()))
+    {
+        module.dump();
+        throw std::runtime_error("internal compiler error: module verification failed");
+    }
+}
+
+/*
+ * lc has no casts, memory holding a value of one type is never accessed
+ * as another, so every type gets a TBAA node of its own.
+ */
+llvm::MDNode * tbaa_tag(llvm::LLVMContext & context, const ast::Type & type)
+{
+    llvm::MDBuilder md(context);
+    llvm::MDNode * root = md.createTBAARoot("lc types");
+    llvm::MDNode * node = md.createTBAAScalarTypeNode(ast::to_string(type), root);
+    return md.createTBAAStructTagNode(node, node, 0);
+}
+
+llvm::Value * gen_load(const codegen::frame & ctx, llvm::Value * address, const ast::Type & type)
+{
+    llvm::LoadInst * load = ctx.session.builder.CreateLoad(address);
+    load->setMetadata(llvm::LLVMContext::MD_tbaa, tbaa_tag(ctx.session.context, type));
+    return load;
+}
+
+void gen_store(const codegen::frame & ctx, llvm::Value * value, llvm::Value * address, const ast::Type & type)
+{
+    llvm::StoreInst * store = ctx.session.builder.CreateStore(value, address);
+    store->setMetadata(llvm::LLVMContext::MD_tbaa, tbaa_tag(ctx.session.context, type));
 }
 
 template <typename T>
@@ -34,19 +66,29 @@ llvm::Value * gen_rvalue(const codegen::frame & ctx, T expr)
 {
     codegen::typed_value v = ctx.gen_expr(expr);
     if (v.second.first == codegen::value_type::LVALUE)
-        return get_builder().CreateLoad(v.second.second);
+        return gen_load(ctx, v.second.second, v.first);
     return v.second.second;
 }
+
+std::unique_ptr<codegen::debug_info> gen_debug_info(const codegen::session & session, llvm::Module & module,
+                                                    const char * name)
+{
+    if (!session.emit_debug_info)
+        return nullptr;
+    return std::unique_ptr<codegen::debug_info>(new codegen::debug_info(module, name));
+}
 }
 
 namespace codegen
 {
-std::unique_ptr<llvm::Module> generate(const Code & code, const char * name)
+std::unique_ptr<llvm::Module> generate(session & session, const Code & code, const char * name)
 {
-    std::unique_ptr<llvm::Module> result(new llvm::Module(name, llvm::getGlobalContext()));
+    std::unique_ptr<llvm::Module> result(new llvm::Module(name, session.context));
     gen_static_data(result.get());
 
-    frame ctx(result.get());
+    frame ctx(session, result.get());
+    std::unique_ptr<debug_info> debug = gen_debug_info(session, *result, name);
+    ctx.debug = debug.get();
 
     for (const auto & entry : code.entries)
         fmap([&ctx], x, gen_declaration(ctx, x), entry.entry);
@@ -54,74 +96,122 @@ std::unique_ptr<llvm::Module> generate(const Code & code, const char * name)
     for (const auto & entry : code.entries)
         fmap([&ctx], x, gen_entry(ctx, x), entry.entry);
 
-    if (llvm::verifyModule(*result, &llvm::errs()))
+    if (debug)
+        debug->finalize();
+    verify_module(*result);
+
+    return std::move(result);
+}
+
+std::unique_ptr<llvm::Module> generate_function(session & session, const Code & code,
+                                                const Function & function, const char * name)
+{
+    std::unique_ptr<llvm::Module> result(new llvm::Module(name, session.context));
+    gen_static_data(result.get());
+
+    frame ctx(session, result.get());
+    std::unique_ptr<debug_info> debug = gen_debug_info(session, *result, name);
+    ctx.debug = debug.get();
+
+    for (const auto & entry : code.entries)
     {
-        result->dump();
-        throw std::runtime_error("internal compiler error: module verification failed");
+        const Variable * var = boost::get<Variable>(&entry.entry);
+        if (var)
+            gen_external_declaration(ctx, *var);
+        else
+            gen_declaration(ctx, boost::get<Function>(entry.entry));
     }
 
+    gen_entry(ctx, function);
+
+    if (debug)
+        debug->finalize();
+    verify_module(*result);
+
     return std::move(result);
 }
 
-llvm::Type * gen_type(const ast::AtomType & type)
+std::unique_ptr<llvm::Module> generate_variables(session & session, const Code & code, const char * name)
+{
+    std::unique_ptr<llvm::Module> result(new llvm::Module(name, session.context));
+
+    frame ctx(session, result.get());
+    std::unique_ptr<debug_info> debug = gen_debug_info(session, *result, name);
+    ctx.debug = debug.get();
+
+    for (const auto & entry : code.entries)
+    {
+        const Variable * var = boost::get<Variable>(&entry.entry);
+        if (var)
+            gen_declaration(ctx, *var);
+    }
+
+    if (debug)
+        debug->finalize();
+    verify_module(*result);
+
+    return std::move(result);
+}
+
+llvm::Type * gen_type(llvm::LLVMContext & context, const ast::AtomType & type)
 {
     switch (type.type)
     {
         case ast::AtomType::BOOL:
-            return llvm::Type::getInt1Ty(llvm::getGlobalContext());
+            return llvm::Type::getInt1Ty(context);
         case ast::AtomType::INT:
-            return llvm::Type::getInt64Ty(llvm::getGlobalContext());
+            return llvm::Type::getInt64Ty(context);
     }
 
     throw std::runtime_error("unknown type");
 }
 
-llvm::Type * gen_type(const ast::PointerType & type)
+llvm::Type * gen_type(llvm::LLVMContext & context, const ast::PointerType & type)
 {
-    auto dereferenced = gen_type(*type.type);
+    auto dereferenced = gen_type(context, *type.type);
     return dereferenced->getPointerTo();
 }
 
-llvm::Type * gen_type(const ast::FuncType & type)
+llvm::Type * gen_type(llvm::LLVMContext & context, const ast::FuncType & type)
 {
-    llvm::Type * rettype = gen_type(*type.rettype);
+    llvm::Type * rettype = gen_type(context, *type.rettype);
     std::vector<llvm::Type *> argtypes;
     for (auto argtype : type.argtypes)
-        argtypes.push_back(gen_type(argtype));
+        argtypes.push_back(gen_type(context, argtype));
     return llvm::FunctionType::get(rettype, argtypes, false);
 }
 
-llvm::Type * gen_type(const ast::Type & type)
+llvm::Type * gen_type(llvm::LLVMContext & context, const ast::Type & type)
 {
-    return fmap([], x, gen_type(x), type.type);
+    return fmap([&context], x, gen_type(context, x), type.type);
 }
 
-llvm::Constant * gen_init(const ast::AtomType & type)
+llvm::Constant * gen_init(const frame & ctx, const ast::AtomType & type)
 {
     switch (type.type)
     {
     case ast::AtomType::BOOL:
-        return get_builder().getInt1(false);
+        return ctx.session.builder.getInt1(false);
     case ast::AtomType::INT:
-        return get_builder().getInt64(0);
+        return ctx.session.builder.getInt64(0);
     }
 
     throw std::runtime_error("unknown atom type");
 }
 
-llvm::Constant * gen_init(const ast::PointerType & type)
+llvm::Constant * gen_init(const frame & ctx, const ast::PointerType & type)
 {
     return nullptr;
 }
 
-llvm::Constant * gen_init(const ast::FuncType & type)
+llvm::Constant * gen_init(const frame & ctx, const ast::FuncType & type)
 {
     undefined;
 }
 
-llvm::Constant * gen_init(const ast::Type & type)
+llvm::Constant * gen_init(const frame & ctx, const ast::Type & type)
 {
-    return fmap([], x, gen_init(x), type.type);
+    return fmap([&ctx], x, gen_init(ctx, x), type.type);
 }
 
 void gen_entry(frame & ctx, const Variable & entry)
@@ -129,21 +219,40 @@ void gen_entry(frame & ctx, const Variable & entry)
 
 void gen_entry(frame & ctx, const Function & entry)
 {
-    llvm::Function * f = gen_func_declaration(ctx, entry.name, entry.arguments, entry.type);
+    utils::profiler::scope timer(ctx.session.profiler, "generate " + entry.name, utils::profiler::kind::SPAN);
+
+    llvm::Function * f = gen_func_declaration(ctx, entry.name, entry.arguments, entry.type, entry.effects);
+    if (ctx.session.frame_pointer)
+        f->addFnAttr("no-frame-pointer-elim", "true");
+
+    /* Recursive calls in the body go through `f`, so they are looked up as well */
+    llvm::Function * memoised = nullptr;
+    if (entry.memoise)
+    {
+        memoised = f;
+        f = llvm::Function::Create(memoised->getFunctionType(), llvm::Function::InternalLinkage,
+                                   entry.name + ".body", ctx.module);
+        f->copyAttributesFrom(memoised);
+        gen_memo_wrapper(ctx, memoised, f);
+    }
 
-    llvm::BasicBlock * bb = llvm::BasicBlock::Create(llvm::getGlobalContext(), "entry", f);
-    get_builder().SetInsertPoint(bb);
+    llvm::BasicBlock * bb = llvm::BasicBlock::Create(ctx.session.context, "entry", f);
+    ctx.session.builder.SetInsertPoint(bb);
+    if (ctx.debug)
+        ctx.debug->begin_function(ctx.session.builder, entry, f);
 
-    frame inner_scope(ctx.module, &ctx);
+    ssa_builder ssa;
+    ssa.seal_block(bb);
+
+    frame inner_scope(ctx.session, ctx.module, &ctx);
+    inner_scope.ssa = &ssa;
+    inner_scope.address_taken = address_taken_variables(entry);
     {
         auto proto_it = entry.arguments.begin();
         for (auto arg_it = f->args().begin(); arg_it != f->args().end(); ++arg_it, ++proto_it)
         {
             arg_it->setName(proto_it->name);
-            inner_scope.gen_local_variable(*proto_it);
-            llvm::Value * lval = inner_scope.gen_expr(ast::Value(proto_it->name)).second.second;
-            llvm::Value * rval = &*arg_it;
-            get_builder().CreateStore(rval, lval);
+            inner_scope.gen_local_variable(*proto_it, &*arg_it);
         }
         assert(proto_it == entry.arguments.end());
     }
@@ -151,16 +260,37 @@ void gen_entry(frame & ctx, const Function & entry)
         inner_scope.gen_local_variable(var);
     for (auto statement : entry.statements)
         inner_scope.gen_statement(statement);
-    get_builder().CreateUnreachable();
+    if (!inner_scope.is_terminated())
+        ctx.session.builder.CreateUnreachable();
+    if (ctx.debug)
+        ctx.debug->end_function(ctx.session.builder);
 
-    if (llvm::verifyFunction(*f, &llvm::errs()))
+    if (llvm::verifyFunction(*f, &llvm::errs()) || (memoised && llvm::verifyFunction(*memoised, &llvm::errs())))
     {
         ctx.module->dump();
         throw std::runtime_error("internal compiler error: function verification failed");
     }
 }
 
-llvm::Function * gen_func_declaration(frame & ctx, const std::string & name, const std::list<Variable> & arguments, const ast::Type & rettype)
+namespace
+{
+void gen_function_attributes(llvm::Function * f, const Effects & effects)
+{
+    /* lc has no exceptions */
+    f->setDoesNotThrow();
+
+    if (!effects.io && !effects.writes_memory)
+    {
+        if (effects.reads_memory)
+            f->setOnlyReadsMemory();
+        else
+            f->setDoesNotAccessMemory();
+    }
+}
+}
+
+llvm::Function * gen_func_declaration(frame & ctx, const std::string & name, const std::list<Variable> & arguments, const ast::Type & rettype,
+                                      const Effects & effects)
 {
     if (ctx.is_declared(name))
     {
@@ -170,12 +300,13 @@ llvm::Function * gen_func_declaration(frame & ctx, const std::string & name, con
 
     std::vector <llvm::Type *> args;
     for (const auto & x : arguments)
-        args.push_back(gen_type(x.type));
+        args.push_back(gen_type(ctx.session.context, x.type));
 
     llvm::FunctionType * type = llvm::FunctionType::get(
-            gen_type(rettype), args, false);
+            gen_type(ctx.session.context, rettype), args, false);
 
     llvm::Function * f = llvm::Function::Create(type, llvm::Function::ExternalLinkage, name, ctx.module);
+    gen_function_attributes(f, effects);
 
     ctx.declare({ctx.get_type(ast::FuncDeclaration{nullptr, rettype, name, arguments}), {value_type::LVALUE, f}}, name);
     return f;
@@ -183,12 +314,12 @@ llvm::Function * gen_func_declaration(frame & ctx, const std::string & name, con
 
 typed_value frame::gen_expr(int64_t i) const
 {
-    return {ast::int_type(), {value_type::RVALUE, get_builder().getInt64(i)}};
+    return {ast::int_type(), {value_type::RVALUE, session.builder.getInt64(i)}};
 }
 
 typed_value frame::gen_expr(bool b) const
 {
-    return {ast::bool_type(), {value_type::RVALUE, get_builder().getInt1(b)}};
+    return {ast::bool_type(), {value_type::RVALUE, session.builder.getInt1(b)}};
 }
 
 typed_value frame::gen_expr(const ast::Const & v) const
@@ -198,7 +329,10 @@ typed_value frame::gen_expr(const ast::Const & v) const
 
 typed_value frame::gen_expr(const std::string & v) const
 {
-    return this->get(v);
+    typed_value result = this->get(v);
+    if (result.second.first == value_type::SSA)
+        return {result.first, {value_type::RVALUE, ssa->read_variable(v, session.builder.GetInsertBlock())}};
+    return result;
 }
 
 typed_value frame::gen_expr(const ast::Value & v) const
@@ -206,39 +340,76 @@ typed_value frame::gen_expr(const ast::Value & v) const
     return fmap([this], x, this->gen_expr(x), v.value);
 }
 
+namespace
+{
+/* Right hand side of && and || is evaluated only if the left one does not decide the result */
+typed_value gen_short_circuit(const frame & ctx, const ast::BinOperator & op)
+{
+    llvm::IRBuilder<> & builder = ctx.session.builder;
+    bool is_and = op.oper.oper == ast::Oper::AND;
+
+    llvm::Value * lhs = gen_rvalue(ctx, *op.lhs);
+    llvm::BasicBlock * lhs_end = builder.GetInsertBlock();
+    llvm::Function * f = lhs_end->getParent();
+    llvm::BasicBlock * rhs_block = llvm::BasicBlock::Create(ctx.session.context, is_and ? "and_rhs" : "or_rhs", f);
+    llvm::BasicBlock * end_block = llvm::BasicBlock::Create(ctx.session.context, is_and ? "and_end" : "or_end", f);
+    if (is_and)
+        builder.CreateCondBr(lhs, rhs_block, end_block);
+    else
+        builder.CreateCondBr(lhs, end_block, rhs_block);
+    ctx.seal_block(rhs_block);
+
+    builder.SetInsertPoint(rhs_block);
+    llvm::Value * rhs = gen_rvalue(ctx, *op.rhs);
+    llvm::BasicBlock * rhs_end = builder.GetInsertBlock();
+    builder.CreateBr(end_block);
+    ctx.seal_block(end_block);
+
+    builder.SetInsertPoint(end_block);
+    llvm::PHINode * result = builder.CreatePHI(builder.getInt1Ty(), 2, is_and ? "and" : "or");
+    result->addIncoming(builder.getInt1(!is_and), lhs_end);
+    result->addIncoming(rhs, rhs_end);
+
+    return {ast::bool_type(), {value_type::RVALUE, result}};
+}
+}
+
 typed_value frame::gen_expr(const ast::BinOperator & op) const
 {
+    if (op.oper.oper == ast::Oper::AND || op.oper.oper == ast::Oper::OR)
+        return gen_short_circuit(*this, op);
+
     llvm::Value * lhs = gen_rvalue(*this, *op.lhs);
     llvm::Value * rhs = gen_rvalue(*this, *op.rhs);
 
     switch (op.oper.oper)
     {
         case ast::Oper::PLUS:
-            return {ast::int_type(), {value_type::RVALUE, get_builder().CreateAdd(lhs, rhs)}};
+            return {ast::int_type(), {value_type::RVALUE, session.builder.CreateNSWAdd(lhs, rhs)}};
         case ast::Oper::MINUS:
-            return {ast::int_type(), {value_type::RVALUE, get_builder().CreateSub(lhs, rhs)}};
+            return {ast::int_type(), {value_type::RVALUE, session.builder.CreateNSWSub(lhs, rhs)}};
         case ast::Oper::MULT:
-            return {ast::int_type(), {value_type::RVALUE, get_builder().CreateMul(lhs, rhs)}};
+            return {ast::int_type(), {value_type::RVALUE, session.builder.CreateNSWMul(lhs, rhs)}};
         case ast::Oper::DIV:
-            return {ast::int_type(), {value_type::RVALUE, get_builder().CreateSDiv(lhs, rhs)}};
+            return {ast::int_type(), {value_type::RVALUE, session.builder.CreateSDiv(lhs, rhs)}};
         case ast::Oper::MOD:
-            return {ast::int_type(), {value_type::RVALUE, get_builder().CreateSRem(lhs, rhs)}};
+            return {ast::int_type(), {value_type::RVALUE, session.builder.CreateSRem(lhs, rhs)}};
         case ast::Oper::GT:
-            return {ast::bool_type(), {value_type::RVALUE, get_builder().CreateICmpSGT(lhs, rhs)}};
+            return {ast::bool_type(), {value_type::RVALUE, session.builder.CreateICmpSGT(lhs, rhs)}};
         case ast::Oper::LT:
-            return {ast::bool_type(), {value_type::RVALUE, get_builder().CreateICmpSLT(lhs, rhs)}};
+            return {ast::bool_type(), {value_type::RVALUE, session.builder.CreateICmpSLT(lhs, rhs)}};
         case ast::Oper::EQ:
-            return {ast::bool_type(), {value_type::RVALUE, get_builder().CreateICmpEQ(lhs, rhs)}};
+            return {ast::bool_type(), {value_type::RVALUE, session.builder.CreateICmpEQ(lhs, rhs)}};
         case ast::Oper::GE:
-            return {ast::bool_type(), {value_type::RVALUE, get_builder().CreateICmpSGE(lhs, rhs)}};
+            return {ast::bool_type(), {value_type::RVALUE, session.builder.CreateICmpSGE(lhs, rhs)}};
         case ast::Oper::LE:
-            return {ast::bool_type(), {value_type::RVALUE, get_builder().CreateICmpSLE(lhs, rhs)}};
+            return {ast::bool_type(), {value_type::RVALUE, session.builder.CreateICmpSLE(lhs, rhs)}};
         case ast::Oper::NE:
-            return {ast::bool_type(), {value_type::RVALUE, get_builder().CreateICmpNE(lhs, rhs)}};
+            return {ast::bool_type(), {value_type::RVALUE, session.builder.CreateICmpNE(lhs, rhs)}};
         case ast::Oper::AND:
-            return {ast::bool_type(), {value_type::RVALUE, get_builder().CreateAnd(lhs, rhs)}};
         case ast::Oper::OR:
-            return {ast::bool_type(), {value_type::RVALUE, get_builder().CreateOr(lhs, rhs)}};
+            /* handled by gen_short_circuit */
+            break;
     }
 
     throw std::runtime_error("unknown binary operator");
@@ -258,20 +429,32 @@ typed_value frame::gen_expr(const ast::Call & call) const
     for (const auto & arg : call.arguments)
         args.push_back(gen_rvalue(*this, arg));
 
-    return {this->get_type(call), {value_type::RVALUE, get_builder().CreateCall(f.second.second, args)}};
+    return {this->get_type(call), {value_type::RVALUE, session.builder.CreateCall(f.second.second, args)}};
 }
 
 typed_value frame::gen_expr(const ast::Read & st) const
 {
-    llvm::Value * f = this->module->getNamedValue("scanf");
-    llvm::Value * v = this->get(st.varname).second.second;
-    llvm::Value * format_string = this->module->getNamedValue("scanf_int");
-    std::vector<llvm::Value *> args = { format_string, v };
-    llvm::Value * scanf_result = get_builder().CreateCall(f, args);
-    llvm::Value * eof_const = get_builder().getInt32(EOF);
-    llvm::Value * is_eof = get_builder().CreateICmpNE(scanf_result, eof_const, "is_eof");
+    const char * name = session.io == io_mode::BINARY ? "lc_read_int_binary" : "lc_read_int";
+    llvm::Value * f = this->module->getNamedValue(name);
+    bool is_ssa = is_ssa_variable(st.varname);
+    llvm::Value * v;
+    if (is_ssa)
+    {
+        /* The runtime needs an address, a slot in the entry block is promoted back to SSA by mem2reg */
+        llvm::BasicBlock & entry = session.builder.GetInsertBlock()->getParent()->getEntryBlock();
+        llvm::IRBuilder<> entry_builder(&entry, entry.begin());
+        v = entry_builder.CreateAlloca(session.builder.getInt64Ty(), nullptr, st.varname);
+        gen_store(*this, gen_rvalue(*this, st.varname), v, ast::int_type());
+    }
+    else
+        v = this->get(st.varname).second.second;
+    std::vector<llvm::Value *> args = { v };
+    llvm::Value * read_result = session.builder.CreateCall(f, args);
+    llvm::Value * has_value = session.builder.CreateICmpNE(read_result, session.builder.getInt32(0), "has_value");
+    if (is_ssa)
+        write_variable(st.varname, gen_load(*this, v, ast::int_type()));
 
-    return {this->get_type(st), {value_type::RVALUE, is_eof}};
+    return {this->get_type(st), {value_type::RVALUE, has_value}};
 }
 
 typed_value frame::gen_expr(const ast::Expression & expr) const
@@ -279,134 +462,228 @@ typed_value frame::gen_expr(const ast::Expression & expr) const
     return fmap([this], x, this->gen_expr(x), expr.expression);
 }
 
+namespace
+{
+/* Position of an argument for debug information, 0 for other values */
+unsigned argument_number(llvm::Value * v)
+{
+    llvm::Argument * arg = llvm::dyn_cast_or_null<llvm::Argument>(v);
+    return arg ? arg->getArgNo() + 1 : 0;
+}
+}
+
 void frame::gen_local_variable(const ast::VarDeclaration & v)
 {
-    llvm::Value * val = get_builder().CreateAlloca(gen_type(v.type), nullptr, v.name);
+    gen_local_variable(v, nullptr);
+}
+
+/* Variables whose address is never taken live in SSA registers, the others in an alloca */
+void frame::gen_local_variable(const ast::VarDeclaration & v, llvm::Value * init)
+{
+    llvm::Type * type = gen_type(session.context, v.type);
+    if (ssa && !address_taken.count(v.name))
+    {
+        ssa->declare_variable(v.name, type);
+        this->declare({v.type, {value_type::SSA, nullptr}}, v.name);
+        if (debug)
+            debug->declare_variable(session.builder, v, nullptr, argument_number(init));
+        if (init)
+            write_variable(v.name, init);
+        return;
+    }
+
+    llvm::Value * val = session.builder.CreateAlloca(type, nullptr, v.name);
+    if (init)
+        gen_store(*this, init, val, v.type);
     this->declare({v.type, {value_type::LVALUE, val}}, v.name);
+    if (debug)
+        debug->declare_variable(session.builder, v, val, argument_number(init));
+}
+
+bool frame::is_ssa_variable(const std::string & name) const
+{
+    return this->get(name).second.first == value_type::SSA;
+}
+
+void frame::write_variable(const std::string & name, llvm::Value * value) const
+{
+    ssa->write_variable(name, session.builder.GetInsertBlock(), value);
+    if (debug)
+        debug->set_value(session.builder, name, value);
+}
+
+bool frame::is_terminated() const
+{
+    return session.builder.GetInsertBlock()->getTerminator() != nullptr;
+}
+
+void frame::seal_block(llvm::BasicBlock * block) const
+{
+    if (ssa)
+        ssa->seal_block(block);
 }
 
 void frame::gen_statement(const ast::Assignment & st)
 {
-    llvm::Value * lval = this->gen_expr(st.lvalue).second.second;
+    const ast::Value * value = boost::get<ast::Value>(&st.lvalue.expression);
+    const std::string * name = value ? boost::get<std::string>(&value->value) : nullptr;
+    if (name && is_ssa_variable(*name))
+    {
+        llvm::Value * rval = gen_rvalue(*this, st.rvalue);
+        write_variable(*name, rval);
+        return;
+    }
+
+    typed_value lval = this->gen_expr(st.lvalue);
     llvm::Value * rval = gen_rvalue(*this, st.rvalue);
-    get_builder().CreateStore(rval, lval);
+    gen_store(*this, rval, lval.second.second, lval.first);
 }
 
 void frame::gen_statement(const If & st)
 {
     /* Generate condition */
     llvm::Value * cond = gen_rvalue(*this, st.condition);
-    llvm::Function * f = get_builder().GetInsertBlock()->getParent();
-    llvm::BasicBlock * then_block = llvm::BasicBlock::Create(llvm::getGlobalContext(), "then", f);
-    llvm::BasicBlock * else_block = llvm::BasicBlock::Create(llvm::getGlobalContext(), "else");
-    llvm::BasicBlock * cont_block = llvm::BasicBlock::Create(llvm::getGlobalContext(), "cont");
-    get_builder().CreateCondBr(cond, then_block, else_block);
+    llvm::BasicBlock * cond_end = session.builder.GetInsertBlock();
+    llvm::Function * f = cond_end->getParent();
+    llvm::BasicBlock * then_block = llvm::BasicBlock::Create(session.context, "then", f);
+    llvm::BasicBlock * cont_block = llvm::BasicBlock::Create(session.context, "cont");
+    /* Without 'else' branch the condition jumps straight to the continuation */
+    llvm::BasicBlock * else_block = st.elseBody.empty()
+            ? cont_block : llvm::BasicBlock::Create(session.context, "else");
+    session.builder.CreateCondBr(cond, then_block, else_block);
+    seal_block(then_block);
+
+    /* Blocks falling through to the continuation */
+    std::vector<llvm::BasicBlock *> incoming;
 
     /* Generate 'then' branch */
-    get_builder().SetInsertPoint(then_block);
+    session.builder.SetInsertPoint(then_block);
     for (auto statement : st.thenBody)
         this->gen_statement(statement);
-    get_builder().CreateBr(cont_block);
-    then_block = get_builder().GetInsertBlock();
+    if (!is_terminated())
+        incoming.push_back(session.builder.GetInsertBlock());
 
     /* Generate 'else' branch */
-    f->getBasicBlockList().push_back(else_block);
-    get_builder().SetInsertPoint(else_block);
-    for (auto statement : st.elseBody)
-        this->gen_statement(statement);
-    get_builder().CreateBr(cont_block);
-    else_block = get_builder().GetInsertBlock();
+    if (else_block != cont_block)
+    {
+        f->getBasicBlockList().push_back(else_block);
+        seal_block(else_block);
+        session.builder.SetInsertPoint(else_block);
+        for (auto statement : st.elseBody)
+            this->gen_statement(statement);
+        if (!is_terminated())
+            incoming.push_back(session.builder.GetInsertBlock());
+    }
 
     /* Continue */
+    if (else_block != cont_block && incoming.size() < 2)
+    {
+        /*
+         * Both branches return, or only one falls through and is simply
+         * extended: the rest of the function is generated after it.
+         */
+        delete cont_block;
+        if (!incoming.empty())
+            session.builder.SetInsertPoint(incoming.front());
+        return;
+    }
+    for (llvm::BasicBlock * block : incoming)
+        llvm::BranchInst::Create(cont_block, block);
     f->getBasicBlockList().push_back(cont_block);
-    get_builder().SetInsertPoint(cont_block);
+    seal_block(cont_block);
+    session.builder.SetInsertPoint(cont_block);
 }
 
 void frame::gen_statement(const While & st)
 {
-    llvm::Function * f = get_builder().GetInsertBlock()->getParent();
-    llvm::BasicBlock * while_body = llvm::BasicBlock::Create(llvm::getGlobalContext(), "while_body", f);
-    llvm::BasicBlock * cond_block = llvm::BasicBlock::Create(llvm::getGlobalContext(), "while_cond");
-    llvm::BasicBlock * cont_block = llvm::BasicBlock::Create(llvm::getGlobalContext(), "while_cont");
-    get_builder().CreateBr(cond_block);
+    llvm::Function * f = session.builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock * while_body = llvm::BasicBlock::Create(session.context, "while_body", f);
+    llvm::BasicBlock * cond_block = llvm::BasicBlock::Create(session.context, "while_cond");
+    llvm::BasicBlock * cont_block = llvm::BasicBlock::Create(session.context, "while_cont");
+    session.builder.CreateBr(cond_block);
     this->labels.declare(while_body, st.label);
 
     /* Generate condition */
-    get_builder().SetInsertPoint(cond_block);
+    session.builder.SetInsertPoint(cond_block);
     llvm::Value * cond = gen_rvalue(*this, st.condition);
-    get_builder().CreateCondBr(cond, while_body, cont_block);
+    session.builder.CreateCondBr(cond, while_body, cont_block);
+    seal_block(cont_block);
 
     /* Generate body branch */
-    get_builder().SetInsertPoint(while_body);
+    session.builder.SetInsertPoint(while_body);
     for (auto statement : st.body)
         this->gen_statement(statement);
-    get_builder().CreateBr(cond_block);
-    while_body = get_builder().GetInsertBlock();
+    if (!is_terminated())
+        session.builder.CreateBr(cond_block);
+    /* Continue statements of the body branch to while_body as well */
+    seal_block(while_body);
+    seal_block(cond_block);
 
     /* Continue */
     f->getBasicBlockList().push_back(cond_block);
     f->getBasicBlockList().push_back(cont_block);
-    get_builder().SetInsertPoint(cont_block);
+    session.builder.SetInsertPoint(cont_block);
 }
 
 void frame::gen_statement(const Continue & st)
 {
     llvm::BasicBlock * block = this->labels.get(st.label);
-    get_builder().CreateBr(block);
-
-    llvm::Function * f = get_builder().GetInsertBlock()->getParent();
-    llvm::BasicBlock * unreachable = llvm::BasicBlock::Create(llvm::getGlobalContext(), "unreachable", f);
-    get_builder().SetInsertPoint(unreachable);
-}
-
-llvm::Value * gen_format_string(const frame & ctx, const ast::Type & type)
-{
-    // TODO: check output type
-    llvm::Value * format_ptr = ctx.module->getNamedValue("printf_int");
-    return format_ptr;
+    session.builder.CreateBr(block);
 }
 
 void frame::gen_statement(const ast::Write & st)
 {
-    llvm::Value * f = this->module->getNamedValue("printf");
+    const char * name = session.io == io_mode::BINARY ? "lc_write_int_binary" : "lc_write_int";
+    llvm::Value * f = this->module->getNamedValue(name);
     llvm::Value * v = gen_rvalue(*this, st.expr);
-    llvm::Value * format_string = gen_format_string(*this, this->get_type(st.expr));
-    std::vector<llvm::Value *> args = { format_string, v };
+    std::vector<llvm::Value *> args = { v };
 
-    get_builder().CreateCall(f, args);
+    session.builder.CreateCall(f, args);
 }
 
 void frame::gen_statement(const ast::Return & ret)
 {
-    get_builder().CreateRet(gen_rvalue(*this, ret.expr));
+    llvm::Value * v = gen_rvalue(*this, ret.expr);
+
+    /*
+     * A call with the same prototype reuses the frame of the caller, so
+     * functions calling each other in tail position run in constant stack.
+     * The callee must not see the caller's locals, so none may be in memory.
+     */
+    llvm::CallInst * call = llvm::dyn_cast<llvm::CallInst>(v);
+    llvm::Function * f = session.builder.GetInsertBlock()->getParent();
+    if (session.tail_calls && call && boost::get<ast::Call>(&ret.expr.expression) && address_taken.empty()
+            && call->getCalledValue()->getType() == f->getType())
+        call->setTailCallKind(llvm::CallInst::TCK_MustTail);
 
-    llvm::Function * f = get_builder().GetInsertBlock()->getParent();
-    llvm::BasicBlock * unreachable = llvm::BasicBlock::Create(llvm::getGlobalContext(), "unreachable", f);
-    get_builder().SetInsertPoint(unreachable);
+    session.builder.CreateRet(v);
 }
 
 void frame::gen_statement(const Statement & st)
 {
+    /* Statements after return or continue are dead */
+    if (is_terminated())
+        return;
+    if (debug)
+        debug->set_location(session.builder, st.loc);
     return fmap([this], x, this->gen_statement(x), st.statement);
 }
 
 void gen_static_data(llvm::Module * module)
 {
-    llvm::FunctionType * type = llvm::TypeBuilder<int(...), false>::get(llvm::getGlobalContext());
-    llvm::Function::Create(type, llvm::Function::ExternalLinkage, "printf", module);
+    llvm::LLVMContext & context = module->getContext();
 
-    llvm::Constant * printf_int_init
-            = llvm::ConstantDataArray::getString(llvm::getGlobalContext(), "%d\n");
-    llvm::Value * printf_int = new llvm::GlobalVariable(
-            *module, llvm::TypeBuilder<char[4], false>::get(llvm::getGlobalContext()), true,
-            llvm::GlobalVariable::InternalLinkage, printf_int_init, "printf_int");
+    /* I/O goes through the lc runtime, see runtime/lcrt.h */
+    llvm::FunctionType * read_type
+            = llvm::TypeBuilder<llvm::types::i<32>(llvm::types::i<64> *), true>::get(context);
+    /* The runtime only writes the integer, it does not keep the pointer */
+    llvm::Function::Create(read_type, llvm::Function::ExternalLinkage, "lc_read_int", module)->setDoesNotCapture(1);
+    llvm::Function::Create(read_type, llvm::Function::ExternalLinkage, "lc_read_int_binary", module)->setDoesNotCapture(1);
 
-    llvm::Function::Create(type, llvm::Function::ExternalLinkage, "scanf", module);
-    llvm::Constant * scanf_int_init
-            = llvm::ConstantDataArray::getString(llvm::getGlobalContext(), "%d");
-    llvm::Value * scanf_int = new llvm::GlobalVariable(
-            *module, llvm::TypeBuilder<char[3], false>::get(llvm::getGlobalContext()), true,
-            llvm::GlobalVariable::InternalLinkage, scanf_int_init, "scanf_int");
+    llvm::FunctionType * write_type
+            = llvm::TypeBuilder<void(llvm::types::i<64>), true>::get(context);
+    llvm::Function::Create(write_type, llvm::Function::ExternalLinkage, "lc_write_int", module);
+    llvm::Function::Create(write_type, llvm::Function::ExternalLinkage, "lc_write_int_binary", module);
 }
 
 typed_value frame::gen_expr(const ast::Address & addr) const
@@ -414,22 +691,31 @@ typed_value frame::gen_expr(const ast::Address & addr) const
     typed_value v = this->gen_expr(*addr.expr);
     if (v.second.first != value_type::LVALUE)
         throw sem::semantic_error(addr.loc, "trying to take address of rvalue");
-    llvm::ArrayRef<llvm::Value *> idxList = { get_builder().getInt32(0) };
-    llvm::Value * res = get_builder().CreateGEP(v.second.second, idxList, "address");
-    return {this->get_type(addr), {value_type::RVALUE, res}};
+    /* The address of a function is the function itself, so calls through it stay direct */
+    return {this->get_type(addr), {value_type::RVALUE, v.second.second}};
 }
 
 void gen_declaration(frame & ctx, const Variable & entry)
+{
+    llvm::GlobalVariable * var = new llvm::GlobalVariable(
+            *ctx.module, gen_type(ctx.session.context, entry.type), false,
+            llvm::GlobalVariable::ExternalLinkage, gen_init(ctx, entry.type), entry.name);
+    ctx.declare({entry.type, {value_type::LVALUE, var}}, entry.name);
+    if (ctx.debug)
+        ctx.debug->declare_global(entry, var);
+}
+
+void gen_external_declaration(frame & ctx, const Variable & entry)
 {
     llvm::Value * var = new llvm::GlobalVariable(
-            *ctx.module, gen_type(entry.type), false,
-            llvm::GlobalVariable::ExternalLinkage, gen_init(entry.type), entry.name);
+            *ctx.module, gen_type(ctx.session.context, entry.type), false,
+            llvm::GlobalVariable::ExternalLinkage, nullptr, entry.name);
     ctx.declare({entry.type, {value_type::LVALUE, var}}, entry.name);
 }
 
 void gen_declaration(frame & ctx, const Function & entry)
 {
-    gen_func_declaration(ctx, entry.name, entry.arguments, entry.type);
+    gen_func_declaration(ctx, entry.name, entry.arguments, entry.type, entry.effects);
 }
 
 }
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "session.h"
+#include "ssa.h"
+#include "debug.h"
+
 #include <gen/ast/l.h>
 #include <parse/ast/l.h>
 #include <sem/types.h>
@@ -12,22 +16,32 @@
 
 namespace codegen
 {
-std::unique_ptr<llvm::Module> generate(const Code & code, const char * name);
+std::unique_ptr<llvm::Module> generate(session & session, const Code & code, const char * name);
+/* Module defining only `function`, everything else is declared as external */
+std::unique_ptr<llvm::Module> generate_function(session & session, const Code & code,
+                                                const Function & function, const char * name);
+/* Module defining only global variables */
+std::unique_ptr<llvm::Module> generate_variables(session & session, const Code & code, const char * name);
 
 enum value_type
 {
     LVALUE,
     RVALUE,
+    /* Local variable kept in SSA form by frame::ssa, it has no address */
+    SSA,
 };
 
 using value = std::pair<value_type, llvm::Value *>;
 using typed_value = std::pair<ast::Type, value>;
 struct frame : sem::typed_ctx<value>
 {
-    frame(llvm::Module * module, frame * outer_scope = nullptr)
+    frame(codegen::session & session, llvm::Module * module, frame * outer_scope = nullptr)
         : sem::typed_ctx<value>(outer_scope)
+        , session(session)
         , module(module)
         , labels(&outer_scope->labels)
+        , ssa(outer_scope ? outer_scope->ssa : nullptr)
+        , debug(outer_scope ? outer_scope->debug : nullptr)
     {}
 
     typed_value gen_expr(int64_t i) const;
@@ -43,6 +57,12 @@ struct frame : sem::typed_ctx<value>
     typed_value gen_expr(const ast::Expression & expr) const;
 
     void gen_local_variable(const ast::VarDeclaration & st);
+    void gen_local_variable(const ast::VarDeclaration & st, llvm::Value * init);
+    bool is_ssa_variable(const std::string & name) const;
+    void write_variable(const std::string & name, llvm::Value * value) const;
+    /* Whether the current block already ends with a branch or return */
+    bool is_terminated() const;
+    void seal_block(llvm::BasicBlock * block) const;
 
     void gen_statement(const ast::Assignment & st);
     void gen_statement(const If & st);
@@ -52,23 +72,36 @@ struct frame : sem::typed_ctx<value>
     void gen_statement(const ast::Return & ret);
     void gen_statement(const Statement & st);
 
+    codegen::session & session;
     llvm::Module * module;
     sem::context<llvm::BasicBlock *> labels;
+    ssa_builder * ssa;
+    /* Null unless debug information is emitted */
+    debug_info * debug;
+    /* Locals which need memory, all others are in SSA form */
+    std::set<std::string> address_taken;
 };
 
-llvm::Type * gen_type(const ast::AtomType & type);
-llvm::Type * gen_type(const ast::PointerType & type);
-llvm::Type * gen_type(const ast::FuncType & type);
-llvm::Type * gen_type(const ast::Type & type);
+llvm::Type * gen_type(llvm::LLVMContext & context, const ast::AtomType & type);
+llvm::Type * gen_type(llvm::LLVMContext & context, const ast::PointerType & type);
+llvm::Type * gen_type(llvm::LLVMContext & context, const ast::FuncType & type);
+llvm::Type * gen_type(llvm::LLVMContext & context, const ast::Type & type);
 
-llvm::Function * gen_func_declaration(frame & ctx, const std::string & name, const std::list<Variable> & arguments, const ast::Type & type);
+llvm::Function * gen_func_declaration(frame & ctx, const std::string & name, const std::list<Variable> & arguments, const ast::Type & type,
+                                      const Effects & effects = Effects());
 
 void gen_static_data(llvm::Module * module);
-llvm::Value * gen_format_string(const frame & ctx, const ast::Type & type);
 
 void gen_declaration(frame & ctx, const Variable & entry);
+void gen_external_declaration(frame & ctx, const Variable & entry);
 void gen_declaration(frame & ctx, const Function & entry);
 
+/*
+ * Defines `f` to return what `body` returns for the same int arguments,
+ * looking the result up in memo tables first and filling them on a miss.
+ */
+void gen_memo_wrapper(frame & ctx, llvm::Function * f, llvm::Function * body);
+
 void gen_entry(frame & ctx, const Variable & entry);
 void gen_entry(frame & ctx, const Function & entry);
 }
@@ -0,0 +1,108 @@
+#include "gen.h"
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/GlobalVariable.h>
+
+#include <vector>
+
+namespace codegen
+{
+namespace
+{
+/* Results for a single argument in [0, dense_size) are all kept */
+const uint64_t dense_size = 1 << 16;
+/* Other arguments share a direct-mapped cache, a colliding result replaces the old one */
+const unsigned cache_bits = 12;
+
+llvm::GlobalVariable * gen_table(llvm::Module & module, llvm::Type * type, uint64_t size, const std::string & name)
+{
+    llvm::ArrayType * array = llvm::ArrayType::get(type, size);
+    return new llvm::GlobalVariable(module, array, false, llvm::GlobalValue::InternalLinkage,
+                                    llvm::ConstantAggregateZero::get(array), name);
+}
+
+llvm::Value * gen_element(llvm::IRBuilder<> & builder, llvm::Value * table, std::vector<llvm::Value *> index)
+{
+    index.insert(index.begin(), builder.getInt64(0));
+    return builder.CreateInBoundsGEP(table, index);
+}
+
+/*
+ * Returns the result in `value` if `valid` is set and `keys` hold the
+ * arguments, otherwise calls `body` and stores the result for next time.
+ */
+void gen_lookup(llvm::IRBuilder<> & builder, llvm::Function * body, const std::vector<llvm::Value *> & args,
+                llvm::Value * value, llvm::Value * valid, const std::vector<llvm::Value *> & keys)
+{
+    llvm::Function * f = builder.GetInsertBlock()->getParent();
+    llvm::LLVMContext & context = f->getContext();
+
+    llvm::Value * hit = builder.CreateICmpNE(builder.CreateLoad(valid), builder.getInt8(0));
+    for (std::size_t i = 0; i < keys.size(); ++i)
+        hit = builder.CreateAnd(hit, builder.CreateICmpEQ(builder.CreateLoad(keys[i]), args[i]));
+
+    llvm::BasicBlock * found = llvm::BasicBlock::Create(context, "found", f);
+    llvm::BasicBlock * missing = llvm::BasicBlock::Create(context, "missing", f);
+    builder.CreateCondBr(hit, found, missing);
+
+    builder.SetInsertPoint(found);
+    builder.CreateRet(builder.CreateLoad(value));
+
+    /* Recursive calls may have replaced the entry meanwhile, it is written after the call */
+    builder.SetInsertPoint(missing);
+    llvm::Value * result = builder.CreateCall(body, args);
+    builder.CreateStore(result, value);
+    for (std::size_t i = 0; i < keys.size(); ++i)
+        builder.CreateStore(args[i], keys[i]);
+    builder.CreateStore(builder.getInt8(1), valid);
+    builder.CreateRet(result);
+}
+}
+
+void gen_memo_wrapper(frame & ctx, llvm::Function * f, llvm::Function * body)
+{
+    llvm::IRBuilder<> & builder = ctx.session.builder;
+    llvm::LLVMContext & context = ctx.session.context;
+    llvm::Module & module = *ctx.module;
+    std::string name = f->getName().str();
+
+    std::vector<llvm::Value *> args;
+    for (llvm::Argument & arg : f->args())
+        args.push_back(&arg);
+
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", f));
+    if (args.size() == 1)
+    {
+        llvm::GlobalVariable * values = gen_table(module, f->getReturnType(), dense_size, name + ".memo.values");
+        llvm::GlobalVariable * valid = gen_table(module, builder.getInt8Ty(), dense_size, name + ".memo.valid");
+
+        /* Negative arguments are large unsigned numbers, they go to the cache */
+        llvm::BasicBlock * dense = llvm::BasicBlock::Create(context, "dense", f);
+        llvm::BasicBlock * cached = llvm::BasicBlock::Create(context, "cached", f);
+        builder.CreateCondBr(builder.CreateICmpULT(args[0], builder.getInt64(dense_size)), dense, cached);
+
+        builder.SetInsertPoint(dense);
+        gen_lookup(builder, body, args, gen_element(builder, values, {args[0]}),
+                   gen_element(builder, valid, {args[0]}), {});
+        builder.SetInsertPoint(cached);
+    }
+
+    /* Fibonacci hashing, the top bits of the product are the best mixed */
+    llvm::Value * hash = builder.getInt64(0);
+    for (llvm::Value * arg : args)
+        hash = builder.CreateMul(builder.CreateXor(hash, arg), builder.getInt64(0x9e3779b97f4a7c15));
+    llvm::Value * slot = builder.CreateLShr(hash, 64 - cache_bits);
+
+    uint64_t cache_size = uint64_t(1) << cache_bits;
+    llvm::GlobalVariable * keys = gen_table(module, llvm::ArrayType::get(builder.getInt64Ty(), args.size()),
+                                            cache_size, name + ".memo.cache_keys");
+    llvm::GlobalVariable * values = gen_table(module, f->getReturnType(), cache_size, name + ".memo.cache_values");
+    llvm::GlobalVariable * valid = gen_table(module, builder.getInt8Ty(), cache_size, name + ".memo.cache_valid");
+
+    std::vector<llvm::Value *> key_slots;
+    for (std::size_t i = 0; i < args.size(); ++i)
+        key_slots.push_back(gen_element(builder, keys, {slot, builder.getInt64(i)}));
+    gen_lookup(builder, body, args, gen_element(builder, values, {slot}),
+               gen_element(builder, valid, {slot}), key_slots);
+}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+
+#include <utils/profiler.h>
+
+namespace codegen
+{
+enum class io_mode
+{
+    /* Decimal integers, one per line */
+    TEXT,
+    /* Raw 8 byte little endian integers */
+    BINARY
+};
+
+/*
+ * State shared by code generation of one module. Modules generated
+ * within a session belong to its context and must not outlive it.
+ * A session must not be used by two threads at once, but different
+ * sessions are independent.
+ */
+struct session
+{
+    session()
+        : builder(context)
+        , io(io_mode::TEXT)
+        , emit_debug_info(false)
+        , frame_pointer(false)
+        , tail_calls(false)
+        , profiler(nullptr)
+    {}
+
+    session(const session &) = delete;
+    session & operator=(const session &) = delete;
+
+    llvm::LLVMContext context;
+    llvm::IRBuilder<> builder;
+    /* Format of integers passed through read and write */
+    io_mode io;
+    /* DWARF compile unit, subprograms, line locations and variables */
+    bool emit_debug_info;
+    /* Keep the frame pointer in every function, for stack walking profilers */
+    bool frame_pointer;
+    /* Returned calls with the prototype of the caller are `musttail` */
+    bool tail_calls;
+    /* Optional, receives compile time of every function */
+    utils::profiler * profiler;
+};
+}
@@ -0,0 +1,261 @@
+#include "ssa.h"
+
+#include <utils/fmap.h>
+
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Constants.h>
+
+#include <stdexcept>
+
+namespace codegen
+{
+namespace
+{
+void insert_address_taken(const ast::Expression & expr, std::set<std::string> & variables);
+
+void insert_address_taken(const ast::Value & expr, std::set<std::string> & variables) { }
+void insert_address_taken(const ast::Read & expr, std::set<std::string> & variables) { }
+
+void insert_address_taken(const ast::BinOperator & expr, std::set<std::string> & variables)
+{
+    insert_address_taken(*expr.lhs, variables);
+    insert_address_taken(*expr.rhs, variables);
+}
+
+void insert_address_taken(const ast::Dereference & expr, std::set<std::string> & variables)
+{
+    insert_address_taken(*expr.expr, variables);
+}
+
+void insert_address_taken(const ast::Address & expr, std::set<std::string> & variables)
+{
+    const ast::Value * value = boost::get<ast::Value>(&expr.expr->expression);
+    const std::string * name = value ? boost::get<std::string>(&value->value) : nullptr;
+    if (name)
+        variables.insert(*name);
+    else
+        insert_address_taken(*expr.expr, variables);
+}
+
+void insert_address_taken(const ast::Call & expr, std::set<std::string> & variables)
+{
+    insert_address_taken(*expr.function, variables);
+    for (const auto & arg : expr.arguments)
+        insert_address_taken(arg, variables);
+}
+
+void insert_address_taken(const ast::Expression & expr, std::set<std::string> & variables)
+{
+    fmap([&variables], x, insert_address_taken(x, variables), expr.expression);
+}
+
+void insert_address_taken(const Statement & st, std::set<std::string> & variables);
+
+void insert_address_taken(const ast::Assignment & st, std::set<std::string> & variables)
+{
+    insert_address_taken(st.lvalue, variables);
+    insert_address_taken(st.rvalue, variables);
+}
+
+void insert_address_taken(const If & st, std::set<std::string> & variables)
+{
+    insert_address_taken(st.condition, variables);
+    for (const auto & statement : st.thenBody)
+        insert_address_taken(statement, variables);
+    for (const auto & statement : st.elseBody)
+        insert_address_taken(statement, variables);
+}
+
+void insert_address_taken(const While & st, std::set<std::string> & variables)
+{
+    insert_address_taken(st.condition, variables);
+    for (const auto & statement : st.body)
+        insert_address_taken(statement, variables);
+}
+
+void insert_address_taken(const Continue & st, std::set<std::string> & variables) { }
+
+void insert_address_taken(const ast::Write & st, std::set<std::string> & variables)
+{
+    insert_address_taken(st.expr, variables);
+}
+
+void insert_address_taken(const ast::Return & st, std::set<std::string> & variables)
+{
+    insert_address_taken(st.expr, variables);
+}
+
+void insert_address_taken(const Statement & st, std::set<std::string> & variables)
+{
+    fmap([&variables], x, insert_address_taken(x, variables), st.statement);
+}
+}
+
+std::set<std::string> address_taken_variables(const Function & function)
+{
+    std::set<std::string> variables;
+    for (const auto & statement : function.statements)
+        insert_address_taken(statement, variables);
+    return variables;
+}
+
+ssa_builder::~ssa_builder()
+{
+    for (llvm::PHINode * phi : removed_phis)
+        delete phi;
+}
+
+void ssa_builder::declare_variable(const std::string & variable, llvm::Type * type)
+{
+    types[variable] = type;
+}
+
+void ssa_builder::write_variable(const std::string & variable, llvm::BasicBlock * block, llvm::Value * value)
+{
+    current_definitions[variable][block] = value;
+}
+
+llvm::Value * ssa_builder::read_variable(const std::string & variable, llvm::BasicBlock * block)
+{
+    definitions & defs = current_definitions[variable];
+
+    /*
+     * Chains of blocks with a single predecessor are walked iteratively,
+     * straight line code can be long enough to exhaust the stack otherwise.
+     */
+    std::vector<llvm::BasicBlock *> chain;
+    llvm::Value * result = nullptr;
+    while (true)
+    {
+        auto it = defs.find(block);
+        if (it != defs.end())
+        {
+            result = it->second;
+            break;
+        }
+
+        llvm::BasicBlock * predecessor = block->getSinglePredecessor();
+        if (!sealed_blocks.count(block) || !predecessor)
+        {
+            result = read_variable_recursive(variable, block);
+            break;
+        }
+        chain.push_back(block);
+        block = predecessor;
+    }
+
+    result = resolve(result);
+    for (llvm::BasicBlock * b : chain)
+        defs[b] = result;
+    return result;
+}
+
+llvm::Value * ssa_builder::read_variable_recursive(const std::string & variable, llvm::BasicBlock * block)
+{
+    llvm::Value * result;
+    if (!sealed_blocks.count(block))
+    {
+        llvm::PHINode * phi = create_phi(variable, block);
+        incomplete_phis[block].push_back({variable, phi});
+        result = phi;
+    }
+    else if (llvm::pred_begin(block) == llvm::pred_end(block))
+    {
+        /* Read before any assignment */
+        result = llvm::UndefValue::get(types.at(variable));
+    }
+    else
+    {
+        /* Breaks cycles: the phi is the definition while its operands are read */
+        llvm::PHINode * phi = create_phi(variable, block);
+        write_variable(variable, block, phi);
+        result = add_phi_operands(variable, phi);
+    }
+    write_variable(variable, block, result);
+    return result;
+}
+
+llvm::PHINode * ssa_builder::create_phi(const std::string & variable, llvm::BasicBlock * block)
+{
+    llvm::PHINode * phi;
+    if (block->empty())
+        phi = llvm::PHINode::Create(types.at(variable), 0, variable, block);
+    else
+        phi = llvm::PHINode::Create(types.at(variable), 0, variable, &block->front());
+    phi_variables[phi] = variable;
+    return phi;
+}
+
+llvm::Value * ssa_builder::add_phi_operands(const std::string & variable, llvm::PHINode * phi)
+{
+    llvm::BasicBlock * block = phi->getParent();
+    for (auto it = llvm::pred_begin(block); it != llvm::pred_end(block); ++it)
+        phi->addIncoming(read_variable(variable, *it), *it);
+    return try_remove_trivial_phi(phi);
+}
+
+llvm::Value * ssa_builder::try_remove_trivial_phi(llvm::PHINode * phi)
+{
+    llvm::Value * same = nullptr;
+    for (llvm::Value * op : phi->incoming_values())
+    {
+        if (op == same || op == phi)
+            continue;
+        if (same)
+            return phi;
+        same = op;
+    }
+    if (!same)
+        same = llvm::UndefValue::get(phi->getType());
+
+    std::vector<llvm::PHINode *> users;
+    for (llvm::User * user : phi->users())
+    {
+        llvm::PHINode * user_phi = llvm::dyn_cast<llvm::PHINode>(user);
+        if (user_phi && user_phi != phi && phi_variables.count(user_phi))
+            users.push_back(user_phi);
+    }
+
+    std::string variable = phi_variables.at(phi);
+    for (auto & def : current_definitions[variable])
+        if (def.second == phi)
+            def.second = same;
+
+    /*
+     * Callers up the stack may still hold the phi, so it is only detached
+     * here and deleted with the builder, `resolve` gives its replacement.
+     */
+    phi->replaceAllUsesWith(same);
+    phi->removeFromParent();
+    phi->dropAllReferences();
+    phi_variables.erase(phi);
+    replacements[phi] = same;
+    removed_phis.push_back(phi);
+
+    for (llvm::PHINode * user : users)
+        if (phi_variables.count(user))
+            try_remove_trivial_phi(user);
+
+    return resolve(same);
+}
+
+llvm::Value * ssa_builder::resolve(llvm::Value * value) const
+{
+    for (auto it = replacements.find(value); it != replacements.end(); it = replacements.find(value))
+        value = it->second;
+    return value;
+}
+
+void ssa_builder::seal_block(llvm::BasicBlock * block)
+{
+    auto it = incomplete_phis.find(block);
+    if (it != incomplete_phis.end())
+    {
+        auto phis = std::move(it->second);
+        incomplete_phis.erase(it);
+        for (const auto & phi : phis)
+            add_phi_operands(phi.first, phi.second);
+    }
+    sealed_blocks.insert(block);
+}
+}
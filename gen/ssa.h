@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ast/l.h"
+
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Type.h>
+#include <llvm/IR/Value.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace codegen
+{
+/* Local variables and arguments of `function` used as operands of '&' */
+std::set<std::string> address_taken_variables(const Function & function);
+
+/*
+ * Builds SSA form for local variables while their function is generated,
+ * as described in Braun et al., "Simple and Efficient Construction of
+ * Static Single Assignment Form". A block has to be sealed once all of
+ * its predecessors are known, reads in unsealed blocks get incomplete
+ * phis which are filled in when it is sealed.
+ */
+struct ssa_builder
+{
+    ssa_builder() = default;
+    ssa_builder(const ssa_builder &) = delete;
+    ssa_builder & operator=(const ssa_builder &) = delete;
+    ~ssa_builder();
+
+    void declare_variable(const std::string & variable, llvm::Type * type);
+    void write_variable(const std::string & variable, llvm::BasicBlock * block, llvm::Value * value);
+    llvm::Value * read_variable(const std::string & variable, llvm::BasicBlock * block);
+    void seal_block(llvm::BasicBlock * block);
+
+private:
+    using definitions = std::map<llvm::BasicBlock *, llvm::Value *>;
+
+    llvm::Value * read_variable_recursive(const std::string & variable, llvm::BasicBlock * block);
+    llvm::PHINode * create_phi(const std::string & variable, llvm::BasicBlock * block);
+    llvm::Value * add_phi_operands(const std::string & variable, llvm::PHINode * phi);
+    llvm::Value * try_remove_trivial_phi(llvm::PHINode * phi);
+    llvm::Value * resolve(llvm::Value * value) const;
+
+    std::map<std::string, llvm::Type *> types;
+    std::map<std::string, definitions> current_definitions;
+    std::set<llvm::BasicBlock *> sealed_blocks;
+    std::map<llvm::BasicBlock *, std::vector<std::pair<std::string, llvm::PHINode *>>> incomplete_phis;
+    /* Phis created by the builder, with the variable they define */
+    std::map<llvm::PHINode *, std::string> phi_variables;
+    std::map<llvm::Value *, llvm::Value *> replacements;
+    std::vector<llvm::PHINode *> removed_phis;
+};
+}
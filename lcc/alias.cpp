@@ -0,0 +1,96 @@
+#include "alias.h"
+
+#include <llvm/Analysis/CaptureTracking.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Attributes.h>
+#include <llvm/IR/Instructions.h>
+
+#include <vector>
+
+namespace
+{
+llvm::AttributeSet argument_attribute(const llvm::Argument & arg, llvm::Attribute::AttrKind kind)
+{
+    return llvm::AttributeSet::get(arg.getContext(), arg.getArgNo() + 1, kind);
+}
+
+std::vector<llvm::Argument *> pointer_arguments(llvm::Module & module)
+{
+    std::vector<llvm::Argument *> result;
+    for (llvm::Function & f : module)
+    {
+        if (f.isDeclaration())
+            continue;
+        for (llvm::Argument & arg : f.args())
+            if (arg.getType()->isPointerTy())
+                result.push_back(&arg);
+    }
+    return result;
+}
+
+/*
+ * Starts from every argument being nocapture and drops the ones which
+ * are captured until nothing changes, so arguments only passed around
+ * between (mutually) recursive functions stay nocapture.
+ */
+void infer_nocapture(const std::vector<llvm::Argument *> & arguments)
+{
+    for (llvm::Argument * arg : arguments)
+        arg->addAttr(argument_attribute(*arg, llvm::Attribute::NoCapture));
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (llvm::Argument * arg : arguments)
+        {
+            if (!arg->hasNoCaptureAttr() || !llvm::PointerMayBeCaptured(arg, true, true))
+                continue;
+            arg->removeAttr(argument_attribute(*arg, llvm::Attribute::NoCapture));
+            changed = true;
+        }
+    }
+}
+
+/* The only way to reach the memory of `arg` during the call is through `arg` */
+bool is_noalias(const llvm::Argument & arg, const llvm::DataLayout & layout)
+{
+    const llvm::Function * f = arg.getParent();
+    if (f->hasAddressTaken())
+        return false;
+
+    for (const llvm::User * user : f->users())
+    {
+        const llvm::CallInst * call = llvm::dyn_cast<llvm::CallInst>(user);
+        if (!call)
+            return false;
+
+        llvm::Value * object = llvm::GetUnderlyingObject(call->getArgOperand(arg.getArgNo()), layout);
+        if (!llvm::isa<llvm::AllocaInst>(object) || llvm::PointerMayBeCaptured(object, true, true))
+            return false;
+
+        for (unsigned i = 0; i < call->getNumArgOperands(); ++i)
+            if (i != arg.getArgNo() && llvm::GetUnderlyingObject(call->getArgOperand(i), layout) == object)
+                return false;
+    }
+    return true;
+}
+}
+
+void lcc::infer_argument_attributes(llvm::Module & module, bool whole_program)
+{
+    std::vector<llvm::Argument *> arguments = pointer_arguments(module);
+    infer_nocapture(arguments);
+
+    /* Callers in other modules could pass anything */
+    if (!whole_program)
+        return;
+
+    /* Decided before any is set, noalias must not depend on the attributes being added */
+    std::vector<llvm::Argument *> noalias;
+    for (llvm::Argument * arg : arguments)
+        if (is_noalias(*arg, module.getDataLayout()))
+            noalias.push_back(arg);
+    for (llvm::Argument * arg : noalias)
+        arg->addAttr(argument_attribute(*arg, llvm::Attribute::NoAlias));
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <llvm/IR/Module.h>
+
+namespace lcc
+{
+/*
+ * Marks pointer arguments `nocapture` when the function never lets the
+ * pointer outlive the call. When `whole_program` is set, an argument is
+ * also `noalias` if every caller passes a local variable whose address
+ * does not escape otherwise, and no other argument points to it.
+ */
+void infer_argument_attributes(llvm::Module & module, bool whole_program);
+}
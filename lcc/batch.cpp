@@ -0,0 +1,99 @@
+#include "batch.h"
+#include "session.h"
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+const char * file_extension(lcc::FileType type)
+{
+    switch (type)
+    {
+        case lcc::FileType::LLVM:
+            return ".ll";
+        case lcc::FileType::BITCODE:
+            return ".bc";
+        case lcc::FileType::ASSEMBLY:
+            return ".s";
+        case lcc::FileType::OBJECT:
+            return ".o";
+    }
+
+    throw std::runtime_error("unknown output file type");
+}
+
+void compile_file(lcc::session & s, lcc::file_result & result, lcc::FileType type)
+{
+    utils::profiler::scope timer(s.codegen.profiler, "compile " + result.input, utils::profiler::kind::SPAN);
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        std::ifstream in(result.input);
+        if (!in)
+            throw std::runtime_error("unable to open file");
+
+        std::error_code err;
+        llvm::raw_fd_ostream out(result.output, err, llvm::sys::fs::OpenFlags::F_None);
+        if (err)
+            throw std::runtime_error(result.output + ": " + err.message());
+
+        s.compile(in, out, result.input, type);
+    }
+    catch (const std::exception & e)
+    {
+        result.error = e.what();
+    }
+    result.time = std::chrono::steady_clock::now() - start;
+}
+}
+
+std::string lcc::output_filename(const std::string & input, FileType type)
+{
+    std::string::size_type dot = input.rfind('.');
+    std::string::size_type slash = input.rfind('/');
+    std::string stem = input;
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+        stem = input.substr(0, dot);
+
+    return stem + file_extension(type);
+}
+
+std::vector<lcc::file_result> lcc::compile_files(const std::vector<std::string> & inputs,
+                                                 FileType type, const Options & options,
+                                                 unsigned jobs, utils::profiler * profiler)
+{
+    std::vector<file_result> results(inputs.size());
+    for (std::size_t i = 0; i < inputs.size(); ++i)
+    {
+        results[i].input = inputs[i];
+        results[i].output = output_filename(inputs[i], type);
+    }
+
+    initialise_target();
+
+    std::atomic<std::size_t> next(0);
+    auto worker = [&] ()
+    {
+        session s(options);
+        s.codegen.profiler = profiler;
+        for (std::size_t i = next++; i < results.size(); i = next++)
+            compile_file(s, results[i], type);
+    };
+
+    jobs = std::max(1u, std::min<unsigned>(jobs, results.size()));
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < jobs; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto & thread : threads)
+        thread.join();
+
+    return results;
+}
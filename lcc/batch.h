@@ -0,0 +1,37 @@
+#pragma once
+
+#include "options.h"
+#include "target.h"
+
+#include <utils/profiler.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace lcc
+{
+struct file_result
+{
+    std::string input;
+    std::string output;
+    std::string error;
+    std::chrono::duration<double> time;
+
+    bool succeeded() const
+    {
+        return error.empty();
+    }
+};
+
+std::string output_filename(const std::string & input, FileType type);
+
+/*
+ * Compiles every input into a file next to it, using up to `jobs`
+ * threads. Each thread has its own session, errors are reported per
+ * file instead of being thrown.
+ */
+std::vector<file_result> compile_files(const std::vector<std::string> & inputs,
+                                       FileType type, const Options & options,
+                                       unsigned jobs, utils::profiler * profiler = nullptr);
+}
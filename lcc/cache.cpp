@@ -0,0 +1,238 @@
+#include "cache.h"
+#include "lcc.h"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+namespace
+{
+const char temp_prefix[] = "tmp.";
+/* Other processes may share the directory, their entries are counted by rescanning */
+const unsigned rescan_interval = 256;
+const std::uint64_t default_size_megabytes = 256;
+
+bool read_file(const std::string & filename, std::string & data)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if (!in)
+        return false;
+
+    std::stringstream ss;
+    ss << in.rdbuf();
+    data = ss.str();
+    return static_cast<bool>(in);
+}
+
+/* Cache size in bytes from a size in megabytes, bad values fall back to the default */
+std::uint64_t parse_cache_size(const std::string & megabytes)
+{
+    const char * begin = megabytes.c_str();
+    char * end = nullptr;
+    errno = 0;
+    unsigned long long value = std::strtoull(begin, &end, 10);
+    if (megabytes.empty() || megabytes.find('-') != std::string::npos || errno || *end != '\0'
+        || value > (std::numeric_limits<std::uint64_t>::max() >> 20))
+    {
+        std::cerr << "lcc: ignoring invalid LCC_CACHE_SIZE '" << megabytes << "', using "
+                  << default_size_megabytes << " megabytes" << std::endl;
+        value = default_size_megabytes;
+    }
+    return static_cast<std::uint64_t>(value) << 20;
+}
+
+bool write_file(const std::string & filename, llvm::StringRef data)
+{
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out.write(data.data(), data.size());
+    return static_cast<bool>(out);
+}
+}
+
+lcc::compile_cache::compile_cache(const std::string & directory, std::uint64_t max_size)
+    : directory(directory)
+    , max_size(max_size)
+    , size_estimate(0)
+    , size_known(false)
+    , stores_since_scan(0)
+{
+    if (llvm::sys::fs::create_directories(directory))
+        throw std::runtime_error("unable to create cache directory '" + directory + "'");
+}
+
+std::unique_ptr<lcc::compile_cache> lcc::compile_cache::from_environment()
+{
+    if (get_env_variable("LCC_CACHE", "1") == "0")
+        return nullptr;
+
+    std::string directory = get_env_variable("LCC_CACHE_DIR", "");
+    if (directory.empty())
+    {
+        std::string xdg_cache = get_env_variable("XDG_CACHE_HOME", "");
+        std::string home = get_env_variable("HOME", "");
+        if (!xdg_cache.empty())
+            directory = xdg_cache + "/lcc";
+        else if (!home.empty())
+            directory = home + "/.cache/lcc";
+        else
+            return nullptr;
+    }
+
+    std::uint64_t max_size = parse_cache_size(get_env_variable("LCC_CACHE_SIZE", "256"));
+
+    try
+    {
+        return std::unique_ptr<compile_cache>(new compile_cache(directory, max_size));
+    }
+    catch (const std::runtime_error &)
+    {
+        // Compilation works without cache, just slower
+        return nullptr;
+    }
+}
+
+std::string lcc::compile_cache::key(std::initializer_list<llvm::StringRef> parts)
+{
+    llvm::MD5 hash;
+    for (llvm::StringRef part : parts)
+    {
+        std::string size = std::to_string(part.size()) + ":";
+        hash.update(size);
+        hash.update(part);
+    }
+
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> hex;
+    llvm::MD5::stringifyResult(result, hex);
+    return hex.str().str();
+}
+
+std::string lcc::compile_cache::path(const std::string & key) const
+{
+    return directory + "/" + key;
+}
+
+bool lcc::compile_cache::lookup(const std::string & key, std::string & data) const
+{
+    std::string filename = path(key);
+    if (!read_file(filename, data))
+        return false;
+
+    // Mark entry as recently used
+    utime(filename.c_str(), nullptr);
+    return true;
+}
+
+bool lcc::compile_cache::lookup_file(const std::string & key, const std::string & destination) const
+{
+    std::string data;
+    if (!lookup(key, data))
+        return false;
+
+    if (!write_file(destination, data))
+        throw std::runtime_error("unable to write '" + destination + "'");
+    chmod(destination.c_str(), 0755);
+    return true;
+}
+
+void lcc::compile_cache::store(const std::string & key, llvm::StringRef data)
+{
+    std::string temp_filename = path(temp_prefix + std::string("XXXXXX"));
+    std::vector<char> pattern(temp_filename.begin(), temp_filename.end());
+    pattern.push_back('\0');
+    int fd = mkstemp(pattern.data());
+    if (fd == -1)
+        return;
+    close(fd);
+    temp_filename = pattern.data();
+
+    // Readers see either no entry or a complete one
+    if (!write_file(temp_filename, data)
+        || std::rename(temp_filename.c_str(), path(key).c_str()) != 0)
+    {
+        std::remove(temp_filename.c_str());
+        return;
+    }
+
+    // Replaced entries are counted twice, which only makes the next scan earlier
+    size_estimate += data.size();
+    if (!size_known || size_estimate > max_size || ++stores_since_scan >= rescan_interval)
+        evict();
+}
+
+void lcc::compile_cache::store_file(const std::string & key, const std::string & source)
+{
+    std::string data;
+    if (read_file(source, data))
+        store(key, data);
+}
+
+void lcc::compile_cache::evict()
+{
+    struct entry
+    {
+        std::string filename;
+        std::uint64_t size;
+        time_t last_used;
+    };
+
+    DIR * dir = opendir(directory.c_str());
+    if (!dir)
+        return;
+
+    std::vector<entry> entries;
+    std::uint64_t total_size = 0;
+    while (dirent * d = readdir(dir))
+    {
+        if (d->d_name[0] == '.' || std::strncmp(d->d_name, temp_prefix, sizeof(temp_prefix) - 1) == 0)
+            continue;
+
+        std::string filename = path(d->d_name);
+        struct stat st;
+        if (stat(filename.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        entries.push_back({filename, static_cast<std::uint64_t>(st.st_size), st.st_mtime});
+        total_size += st.st_size;
+    }
+    closedir(dir);
+
+    size_known = true;
+    stores_since_scan = 0;
+    size_estimate = total_size;
+    if (total_size <= max_size)
+        return;
+
+    std::sort(entries.begin(), entries.end(), [] (const entry & lhs, const entry & rhs)
+    {
+        return lhs.last_used < rhs.last_used;
+    });
+    // Room for more stores before the limit is reached and the directory scanned again
+    std::uint64_t target_size = max_size / 4 * 3;
+    for (const entry & e : entries)
+    {
+        if (total_size <= target_size)
+            break;
+        if (std::remove(e.filename.c_str()) == 0)
+            total_size -= e.size;
+    }
+    size_estimate = total_size;
+}
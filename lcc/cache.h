@@ -0,0 +1,48 @@
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+
+namespace lcc
+{
+/*
+ * On-disk content-addressed storage of compilation results. Entries
+ * are written atomically, so several processes can share one cache
+ * directory. Once the total size exceeds the limit, least recently
+ * used entries are removed. The size is tracked by the stores of this
+ * instance and only read from the directory now and then.
+ */
+struct compile_cache
+{
+    compile_cache(const std::string & directory, std::uint64_t max_size);
+
+    /*
+     * Cache configured by LCC_CACHE_DIR (default is
+     * $XDG_CACHE_HOME/lcc or ~/.cache/lcc) and LCC_CACHE_SIZE (in MiB).
+     * Returns nullptr if LCC_CACHE is set to 0 or no directory is known.
+     */
+    static std::unique_ptr<compile_cache> from_environment();
+
+    static std::string key(std::initializer_list<llvm::StringRef> parts);
+
+    bool lookup(const std::string & key, std::string & data) const;
+    bool lookup_file(const std::string & key, const std::string & destination) const;
+    void store(const std::string & key, llvm::StringRef data);
+    void store_file(const std::string & key, const std::string & source);
+
+private:
+    std::string path(const std::string & key) const;
+    void evict();
+
+    std::string directory;
+    std::uint64_t max_size;
+    /* Total size at the last scan of the directory plus the stores since */
+    std::uint64_t size_estimate;
+    bool size_known;
+    unsigned stores_since_scan;
+};
+}
@@ -0,0 +1,245 @@
+#include "devirtualise.h"
+
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+
+#include <algorithm>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+/* More possible callees are left as an indirect call */
+const std::size_t max_guarded_callees = 4;
+
+using callees = std::set<llvm::Function *>;
+
+llvm::FunctionType * called_type(const llvm::CallInst * call)
+{
+    return llvm::cast<llvm::FunctionType>(call->getCalledValue()->getType()->getPointerElementType());
+}
+
+bool is_indirect(const llvm::CallInst * call)
+{
+    return !llvm::isa<llvm::Function>(call->getCalledValue()->stripPointerCasts());
+}
+
+struct callee_analysis
+{
+    callee_analysis(llvm::Module & module, bool whole_program)
+        : whole_program(whole_program)
+    {
+        for (llvm::Function & f : module)
+            for (llvm::BasicBlock & block : f)
+                for (llvm::Instruction & inst : block)
+                {
+                    llvm::CallInst * call = llvm::dyn_cast<llvm::CallInst>(&inst);
+                    if (call && is_indirect(call))
+                        indirect_calls.push_back(call);
+                }
+    }
+
+    /* Adds every function `v` can point to, false if it can be an unknown pointer */
+    bool collect(llvm::Value * v, callees & result)
+    {
+        std::set<llvm::Value *> visited;
+        return collect(v, result, visited);
+    }
+
+    bool whole_program;
+    std::vector<llvm::CallInst *> indirect_calls;
+
+private:
+    bool collect(llvm::Value * v, callees & result, std::set<llvm::Value *> & visited)
+    {
+        v = v->stripPointerCasts();
+        /* A cycle adds nothing which is not reached from its other values */
+        if (!visited.insert(v).second)
+            return true;
+
+        if (llvm::Function * f = llvm::dyn_cast<llvm::Function>(v))
+        {
+            result.insert(f);
+            return true;
+        }
+        /* Calling through null or undef is undefined anyway */
+        if (llvm::isa<llvm::ConstantPointerNull>(v) || llvm::isa<llvm::UndefValue>(v))
+            return true;
+        if (llvm::PHINode * phi = llvm::dyn_cast<llvm::PHINode>(v))
+        {
+            for (llvm::Value * incoming : phi->incoming_values())
+                if (!collect(incoming, result, visited))
+                    return false;
+            return true;
+        }
+        if (llvm::SelectInst * select = llvm::dyn_cast<llvm::SelectInst>(v))
+            return collect(select->getTrueValue(), result, visited)
+                && collect(select->getFalseValue(), result, visited);
+        if (llvm::LoadInst * load = llvm::dyn_cast<llvm::LoadInst>(v))
+            return !load->isVolatile() && collect_stored(load->getPointerOperand(), result, visited);
+        if (llvm::Argument * arg = llvm::dyn_cast<llvm::Argument>(v))
+            return collect_passed(arg, result, visited);
+        if (llvm::CallInst * call = llvm::dyn_cast<llvm::CallInst>(v))
+            return collect_returned(call, result, visited);
+        return false;
+    }
+
+    /* Values stored to a variable which is only ever loaded and stored to */
+    bool collect_stored(llvm::Value * pointer, callees & result, std::set<llvm::Value *> & visited)
+    {
+        if (llvm::GlobalVariable * global = llvm::dyn_cast<llvm::GlobalVariable>(pointer))
+        {
+            if (!whole_program || !global->hasInitializer())
+                return false;
+            if (!collect(global->getInitializer(), result, visited))
+                return false;
+        }
+        else if (!llvm::isa<llvm::AllocaInst>(pointer))
+            return false;
+
+        for (llvm::User * user : pointer->users())
+        {
+            if (llvm::isa<llvm::LoadInst>(user))
+                continue;
+            llvm::StoreInst * store = llvm::dyn_cast<llvm::StoreInst>(user);
+            if (!store || store->getPointerOperand() != pointer)
+                return false;
+            if (!collect(store->getValueOperand(), result, visited))
+                return false;
+        }
+        return true;
+    }
+
+    /* Arguments given by every caller, only all of them are known in the whole program */
+    bool collect_passed(llvm::Argument * arg, callees & result, std::set<llvm::Value *> & visited)
+    {
+        if (!whole_program)
+            return false;
+
+        llvm::Function * f = arg->getParent();
+        unsigned index = arg->getArgNo();
+        for (llvm::User * user : f->users())
+        {
+            llvm::CallInst * call = llvm::dyn_cast<llvm::CallInst>(user);
+            if (call && call->getCalledValue() == f && !collect(call->getArgOperand(index), result, visited))
+                return false;
+        }
+
+        if (f->hasAddressTaken())
+        {
+            for (llvm::CallInst * call : indirect_calls)
+                if (called_type(call) == f->getFunctionType()
+                        && !collect(call->getArgOperand(index), result, visited))
+                    return false;
+        }
+        return true;
+    }
+
+    bool collect_returned(llvm::CallInst * call, callees & result, std::set<llvm::Value *> & visited)
+    {
+        llvm::Function * f = llvm::dyn_cast<llvm::Function>(call->getCalledValue()->stripPointerCasts());
+        if (!f || f->isDeclaration())
+            return false;
+
+        for (llvm::BasicBlock & block : *f)
+        {
+            llvm::ReturnInst * ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator());
+            if (ret && !collect(ret->getReturnValue(), result, visited))
+                return false;
+        }
+        return true;
+    }
+};
+
+/*
+ * Replaces an indirect call with direct calls of `targets`. All but the
+ * last callee are compared with the pointer, the last one is what is left.
+ */
+void promote(llvm::CallInst * call, const std::vector<llvm::Function *> & targets)
+{
+    if (targets.size() == 1)
+    {
+        call->setCalledFunction(targets.front());
+        return;
+    }
+
+    llvm::Value * callee = call->getCalledValue();
+    llvm::BasicBlock * before = call->getParent();
+    llvm::Function * f = before->getParent();
+    llvm::LLVMContext & context = f->getContext();
+    llvm::BasicBlock * after = before->splitBasicBlock(call, "devirt_cont");
+    before->getTerminator()->eraseFromParent();
+
+    llvm::PHINode * result = nullptr;
+    if (!call->getType()->isVoidTy())
+        result = llvm::PHINode::Create(call->getType(), targets.size(), "devirt", &after->front());
+
+    std::vector<llvm::BasicBlock *> call_blocks;
+    for (llvm::Function * target : targets)
+    {
+        llvm::BasicBlock * block = llvm::BasicBlock::Create(context, "devirt_" + target->getName(), f, after);
+        llvm::CallInst * direct = llvm::cast<llvm::CallInst>(call->clone());
+        direct->setCalledFunction(target);
+        block->getInstList().push_back(direct);
+        llvm::BranchInst::Create(after, block);
+        if (result)
+            result->addIncoming(direct, block);
+        call_blocks.push_back(block);
+    }
+
+    llvm::BasicBlock * check = before;
+    for (std::size_t i = 0; i + 1 < targets.size(); ++i)
+    {
+        llvm::BasicBlock * otherwise = i + 2 < targets.size()
+                ? llvm::BasicBlock::Create(context, "devirt_check", f, call_blocks.front())
+                : call_blocks.back();
+        llvm::IRBuilder<> builder(check);
+        builder.CreateCondBr(builder.CreateICmpEQ(callee, targets[i]), call_blocks[i], otherwise);
+        check = otherwise;
+    }
+
+    if (result)
+        call->replaceAllUsesWith(result);
+    call->eraseFromParent();
+}
+}
+
+void lcc::devirtualise_calls(llvm::Module & module, bool whole_program)
+{
+    callee_analysis analysis(module, whole_program);
+
+    /* Everything is analysed before rewriting, promotion changes the uses the analysis walks */
+    std::vector<std::pair<llvm::CallInst *, std::vector<llvm::Function *>>> promotions;
+    for (llvm::CallInst * call : analysis.indirect_calls)
+    {
+        /* A musttail call has to stay right before its return */
+        if (call->isMustTailCall())
+            continue;
+
+        callees found;
+        if (!analysis.collect(call->getCalledValue(), found))
+            continue;
+
+        std::vector<llvm::Function *> targets;
+        for (llvm::Function * f : found)
+            if (f->getFunctionType() == called_type(call))
+                targets.push_back(f);
+        if (targets.empty() || targets.size() > max_guarded_callees)
+            continue;
+
+        /* By name, the output must not depend on where functions were allocated */
+        std::sort(targets.begin(), targets.end(), [](llvm::Function * a, llvm::Function * b)
+        {
+            return a->getName() < b->getName();
+        });
+        promotions.push_back({call, std::move(targets)});
+    }
+
+    for (const auto & promotion : promotions)
+        promote(promotion.first, promotion.second);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <llvm/IR/Module.h>
+
+namespace lcc
+{
+/*
+ * Turns calls through function pointers into direct calls when the set of
+ * functions the pointer can hold is known. A single possible callee is
+ * called directly, a few are dispatched by comparing the pointer with each
+ * of them, so every call site becomes a candidate for inlining.
+ *
+ * Pointers are traced through phis, selects, local and global variables
+ * only written with stores, function results and, when `whole_program` is
+ * set, through arguments to every call site of their function.
+ */
+void devirtualise_calls(llvm::Module & module, bool whole_program);
+}
@@ -0,0 +1,118 @@
+#include "jit.h"
+#include "target.h"
+
+#include <llvm/ADT/Triple.h>
+#include <llvm/ExecutionEngine/Orc/LambdaResolver.h>
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+#include <llvm/IR/Mangler.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <runtime/lcrt.h>
+#include <runtime/io.h>
+
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+
+namespace
+{
+std::unique_ptr<llvm::TargetMachine> check_jit_target(std::unique_ptr<llvm::TargetMachine> machine)
+{
+    if (machine->getTargetTriple().getArch() != llvm::Triple::x86_64)
+        throw std::runtime_error("JIT is not supported for target '"
+                                 + machine->getTargetTriple().str() + "'");
+    return machine;
+}
+
+/* The lc runtime is linked into lcc, but its symbols are not exported by the executable */
+llvm::orc::TargetAddress runtime_symbol_address(const std::string & name)
+{
+    static const std::map<std::string, void *> symbols = {
+        {"lc_read_int", reinterpret_cast<void *>(&lc_read_int)},
+        {"lc_write_int", reinterpret_cast<void *>(&lc_write_int)},
+        {"lc_read_int_binary", reinterpret_cast<void *>(&lc_read_int_binary)},
+        {"lc_write_int_binary", reinterpret_cast<void *>(&lc_write_int_binary)},
+        {"lc_flush", reinterpret_cast<void *>(&lc_flush)},
+        {"lc_read_int_slow", reinterpret_cast<void *>(&lc_read_int_slow)},
+        {"lc_read_int_binary_slow", reinterpret_cast<void *>(&lc_read_int_binary_slow)},
+        {"lc_input", reinterpret_cast<void *>(&lc_input)},
+        {"lc_output", reinterpret_cast<void *>(&lc_output)},
+    };
+
+    auto it = symbols.find(name);
+    if (it == symbols.end())
+        return 0;
+    return static_cast<llvm::orc::TargetAddress>(reinterpret_cast<std::uintptr_t>(it->second));
+}
+}
+
+lcc::jit::jit(std::unique_ptr<llvm::TargetMachine> machine, llvm::LLVMContext & context)
+    : machine(check_jit_target(std::move(machine)))
+    , compile_layer(object_layer, llvm::orc::SimpleCompiler(*this->machine))
+    , callbacks(compile_layer, callback_memory_manager, context, 0, 64)
+    , cod_layer(compile_layer, callbacks, false)
+{
+    /* getSymbolAddressInProcess only searches libraries loaded permanently, this adds the process itself */
+    static const bool process_loaded = !llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+    (void) process_loaded;
+}
+
+void lcc::jit::add_module(std::unique_ptr<llvm::Module> module)
+{
+    configure_module(*module, *machine);
+
+    /*
+     * Symbols are looked up in the JIT first, so calls between lc
+     * functions go through lazy compilation stubs. The lc runtime
+     * and everything else comes from the lcc process itself.
+     */
+    auto resolver = llvm::orc::createLambdaResolver(
+        [this] (const std::string & name)
+        {
+            if (auto symbol = cod_layer.findSymbol(name, true))
+                return llvm::RuntimeDyld::SymbolInfo(symbol.getAddress(), symbol.getFlags());
+            if (auto address = runtime_symbol_address(name))
+                return llvm::RuntimeDyld::SymbolInfo(address, llvm::JITSymbolFlags::Exported);
+            if (auto address = llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name))
+                return llvm::RuntimeDyld::SymbolInfo(address, llvm::JITSymbolFlags::Exported);
+            return llvm::RuntimeDyld::SymbolInfo(nullptr);
+        },
+        [] (const std::string & name)
+        {
+            return llvm::RuntimeDyld::SymbolInfo(nullptr);
+        });
+
+    std::vector<std::unique_ptr<llvm::Module>> modules;
+    modules.push_back(std::move(module));
+    cod_layer.addModuleSet(std::move(modules),
+                           std::unique_ptr<llvm::SectionMemoryManager>(new llvm::SectionMemoryManager()),
+                           std::move(resolver));
+}
+
+llvm::orc::TargetAddress lcc::jit::get_symbol_address(const std::string & name)
+{
+    auto symbol = cod_layer.findSymbol(mangle(name), true);
+    if (!symbol)
+        throw std::runtime_error("undefined symbol: " + name);
+    return symbol.getAddress();
+}
+
+int lcc::jit::run_main()
+{
+    using main_t = std::int64_t (*)();
+    main_t main = reinterpret_cast<main_t>(static_cast<std::uintptr_t>(get_symbol_address("main")));
+    std::int64_t result = main();
+    lc_flush();
+    return static_cast<int>(result);
+}
+
+std::string lcc::jit::mangle(const std::string & name) const
+{
+    std::string mangled;
+    {
+        llvm::raw_string_ostream out(mangled);
+        llvm::Mangler::getNameWithPrefix(out, name, *machine->getDataLayout());
+    }
+    return mangled;
+}
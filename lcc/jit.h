@@ -0,0 +1,47 @@
+#pragma once
+
+#include <llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
+#include <llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h>
+#include <llvm/ExecutionEngine/Orc/OrcTargetSupport.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <memory>
+#include <string>
+
+namespace lcc
+{
+/*
+ * Lazy JIT on top of ORC: every function of the added module is
+ * replaced by a stub, and the function body gets compiled on its
+ * first call.
+ */
+struct jit
+{
+    using object_layer_t = llvm::orc::ObjectLinkingLayer<>;
+    using compile_layer_t = llvm::orc::IRCompileLayer<object_layer_t>;
+    using callback_manager_t = llvm::orc::JITCompileCallbackManager<compile_layer_t, llvm::orc::OrcX86_64>;
+    using cod_layer_t = llvm::orc::CompileOnDemandLayer<compile_layer_t, callback_manager_t>;
+
+    jit(std::unique_ptr<llvm::TargetMachine> machine, llvm::LLVMContext & context);
+
+    void add_module(std::unique_ptr<llvm::Module> module);
+    llvm::orc::TargetAddress get_symbol_address(const std::string & name);
+    int run_main();
+
+private:
+    std::string mangle(const std::string & name) const;
+
+    std::unique_ptr<llvm::TargetMachine> machine;
+    object_layer_t object_layer;
+    compile_layer_t compile_layer;
+    llvm::SectionMemoryManager callback_memory_manager;
+    callback_manager_t callbacks;
+    cod_layer_t cod_layer;
+};
+}
@@ -1,28 +1,36 @@
 #include "lcc.h"
 
-#include <parse/parser.h>
-#include <parse/ast/l.h>
-#include <gen/gen.h>
-#include <sem/l.h>
-#include <optimise/l.h>
-
-#include <llvm/IR/Module.h>
-#include <llvm/Support/FileSystem.h>
 #include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+void lcc::compile_llvm(std::istream & in, llvm::raw_ostream & out, const std::string & module_name,
+                       const Options & options)
+{
+    session(options).compile_llvm(in, out, module_name);
+}
+
+void lcc::compile_bitcode(std::istream & in, llvm::raw_ostream & out, const std::string & module_name,
+                          const Options & options)
+{
+    session(options).compile_bitcode(in, out, module_name);
+}
 
-void lcc::compile_llvm(std::istream & in, llvm::raw_ostream & out, const std::string & module_name, Optimisations opt)
+void lcc::compile_native(std::istream & in, llvm::raw_pwrite_stream & out, const std::string & module_name,
+                         FileType type, const Options & options)
 {
-    ast::parser p;
-    ast::Code code = p.parse(in, std::cout);
-    sem::verify(code);
-    codegen::Code gen_code(code);
-    if (opt >= Optimisations::ACC)
-        optimise::optimise_to_accum(gen_code);
-    if (opt >= Optimisations::TCO)
-        optimise::optimise_tail_call(gen_code);
-    std::unique_ptr<llvm::Module> module = codegen::generate(gen_code, module_name.c_str());
+    session(options).compile_native(in, out, module_name, type);
+}
 
-    module->print(out, nullptr);
+void lcc::compile(std::istream & in, llvm::raw_pwrite_stream & out, const std::string & module_name,
+                  FileType type, const Options & options)
+{
+    session(options).compile(in, out, module_name, type);
+}
+
+int lcc::run(std::istream & in, const std::string & module_name, const Options & options)
+{
+    return session(options).run(in, module_name);
 }
 
 std::string lcc::create_temp_file(const char * pattern, std::size_t suffix_size)
@@ -34,33 +42,10 @@ std::string lcc::create_temp_file(const char * pattern, std::size_t suffix_size)
     return filename;
 }
 
-void lcc::compile_executable(std::istream & in, const std::string & output_name, Optimisations opt)
+void lcc::compile_executable(std::istream & in, const std::string & module_name,
+                             const std::string & output_name, const Options & options)
 {
-    std::string ll_filename = create_temp_file("lcc_XXXXXX.ll", 3);
-    {
-        std::error_code err;
-        llvm::raw_fd_ostream out(ll_filename, err, llvm::sys::fs::OpenFlags::F_None);
-        compile_llvm(in, out, output_name, opt);
-    }
-
-    std::string object_filename = create_temp_file("lcc_XXXXXX.o", 2);
-    {
-        std::string command(get_env_variable("LLC", "llc"));
-        command += " -o=";
-        command += object_filename;
-        command += " --filetype=obj ";
-        command += ll_filename;
-        std::system(command.c_str());
-    }
-
-    {
-        std::string command(get_env_variable("CC", "gcc"));
-        command += " -o ";
-        command += output_name;
-        command += " ";
-        command += object_filename;
-        std::system(command.c_str());
-    }
+    session(options).compile_executable(in, module_name, output_name);
 }
 
 std::string lcc::get_env_variable(const char * varname, const char * default_value)
@@ -0,0 +1,76 @@
+#include "link.h"
+#include "lcc.h"
+
+#ifdef LCC_HAVE_LLD
+#include <lld/Driver/Driver.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <mutex>
+#endif
+
+#include <cstdlib>
+#include <stdexcept>
+
+namespace
+{
+std::vector<std::string> linker_arguments(const std::vector<std::string> & objects, const std::string & output_name)
+{
+    std::vector<std::string> args = {"-static", "-o", output_name};
+    args.insert(args.end(), objects.begin(), objects.end());
+    args.push_back(lcc::runtime_library());
+    return args;
+}
+
+#ifdef LCC_HAVE_LLD
+void link_in_process(const std::vector<std::string> & args)
+{
+    /* lld keeps its state in globals, so only one link can run at a time */
+    static std::mutex lld_mutex;
+    std::lock_guard<std::mutex> lock(lld_mutex);
+
+    std::vector<const char *> argv = {"ld.lld"};
+    for (const auto & arg : args)
+        argv.push_back(arg.c_str());
+
+    std::string diagnostics;
+    llvm::raw_string_ostream diagnostics_out(diagnostics);
+    if (!lld::elf::link(argv, diagnostics_out))
+        throw std::runtime_error("linking failed: " + diagnostics_out.str());
+}
+#else
+void link_external(const std::vector<std::string> & args)
+{
+    std::string command(lcc::get_env_variable("LD", "ld"));
+    for (const auto & arg : args)
+    {
+        command += " '";
+        command += arg;
+        command += "'";
+    }
+
+    if (std::system(command.c_str()) != 0)
+        throw std::runtime_error("linking failed: " + command);
+}
+#endif
+}
+
+std::string lcc::runtime_library()
+{
+    return get_env_variable("LCC_RUNTIME", LCC_RUNTIME);
+}
+
+std::string lcc::runtime_bitcode()
+{
+    return get_env_variable("LCC_RUNTIME_BITCODE", LCC_RUNTIME_BITCODE);
+}
+
+void lcc::link_executable(const std::vector<std::string> & objects, const std::string & output_name)
+{
+    std::vector<std::string> args = linker_arguments(objects, output_name);
+#ifdef LCC_HAVE_LLD
+    link_in_process(args);
+#else
+    link_external(args);
+#endif
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace lcc
+{
+/* Path of the lc runtime library, LCC_RUNTIME overrides the one built with lcc */
+std::string runtime_library();
+/* Path of the runtime I/O fast path bitcode, empty if lcc was built without it */
+std::string runtime_bitcode();
+
+/*
+ * Links objects and the lc runtime into a static executable. Uses lld
+ * in-process when lcc was built with it, $LD (ld by default) otherwise.
+ */
+void link_executable(const std::vector<std::string> & objects, const std::string & output_name);
+}
@@ -1,54 +1,294 @@
 #include "lcc.h"
+#include "batch.h"
+#include "server.h"
 
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <utils/profiler.h>
+
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 void usage(const char * program)
 {
-    std::cerr << "Usage: " << program << " [-O{0,1,2}] <input> <output>" << std::endl;
+    std::cerr << "Usage: " << program << " [-O{0,1,2,3,s,z}] [-g] [-fno-omit-frame-pointer] [-fmemoise] [--incremental] [--binary-io] [--emit={llvm,bc,asm,obj}] <input> <output>" << std::endl;
+    std::cerr << "       " << program << " [-O{0,1,2,3,s,z}] --run <input>" << std::endl;
+    std::cerr << "       " << program << " [-O{0,1,2,3,s,z}] [--emit={llvm,bc,asm,obj}] -j <jobs> <input>..." << std::endl;
+    std::cerr << "       " << program << " --server <socket>" << std::endl;
+    std::cerr << "       " << program << " [-O{0,1,2,3,s,z}] [--emit={llvm,bc,asm,obj}] --connect <socket> <input> <output>" << std::endl;
+    std::cerr << "Options: --time-report prints time and memory spent in every phase," << std::endl;
+    std::cerr << "         --trace=<file> writes Chrome trace events of phases and functions" << std::endl;
     exit(EXIT_FAILURE);
 }
 
-int main(int argc, char ** argv)
+lcc::Options parse_optimisations(const char * program, const std::string & level)
 {
-    if (argc < 3)
-        usage(argv[0]);
+    if (level == "0")
+        return lcc::Optimisations::NONE;
+    if (level == "1")
+        return lcc::Optimisations::TCO;
+    if (level == "2")
+        return lcc::Optimisations::ACC;
+    if (level == "3")
+        return lcc::Optimisations::AGGRESSIVE;
+    if (level == "s")
+        return lcc::Options(lcc::Optimisations::ACC, 1);
+    if (level == "z")
+        return lcc::Options(lcc::Optimisations::ACC, 2);
+
+    usage(program);
+    return lcc::Optimisations::NONE;
+}
+
+lcc::FileType parse_file_type(const char * program, const std::string & type)
+{
+    if (type == "llvm")
+        return lcc::FileType::LLVM;
+    if (type == "bc")
+        return lcc::FileType::BITCODE;
+    if (type == "asm")
+        return lcc::FileType::ASSEMBLY;
+    if (type == "obj")
+        return lcc::FileType::OBJECT;
+
+    usage(program);
+    return lcc::FileType::LLVM;
+}
+
+unsigned parse_jobs(const char * program, const std::string & jobs)
+{
+    if (jobs.empty() || jobs.find_first_not_of("0123456789") != std::string::npos)
+        usage(program);
 
-    lcc::Optimisations opt = lcc::Optimisations::ACC;
-    const char * input = argv[1];
-    const char * output = argv[2];
+    unsigned result = std::stoul(jobs);
+    if (result == 0)
+        return std::max(1u, std::thread::hardware_concurrency());
+    return result;
+}
+
+int compile_files(const std::vector<const char *> & files, lcc::FileType type,
+                  const lcc::Options & options, unsigned jobs, utils::profiler * profiler)
+{
+    std::vector<std::string> inputs(files.begin(), files.end());
 
-    if (argv[1][0] == '-')
+    auto start = std::chrono::steady_clock::now();
+    std::vector<lcc::file_result> results = lcc::compile_files(inputs, type, options, jobs, profiler);
+    std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - start;
+
+    std::size_t failed = 0;
+    std::chrono::duration<double> compile_time(0);
+    for (const auto & result : results)
     {
-        if (argv[1][1] != 'O')
-            usage(argv[0]);
-        switch (argv[1][2])
+        compile_time += result.time;
+        if (!result.succeeded())
+        {
+            std::cerr << result.input << ": " << result.error << std::endl;
+            ++failed;
+        }
+    }
+
+    std::cerr << "compiled " << results.size() - failed << " of " << results.size() << " files"
+              << " in " << wall_time.count() << " s"
+              << " (" << compile_time.count() << " s total compile time)" << std::endl;
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int compile_remote(const std::string & socket_path, const char * input, const char * output,
+                   lcc::FileType type, const lcc::Options & options)
+{
+    std::ifstream in(input);
+    if (!in)
+    {
+        std::cerr << input << ": unable to open file" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::stringstream source;
+    source << in.rdbuf();
+
+    lcc::compile_reply reply = lcc::request_compile(socket_path, source.str(), input, type, options);
+    if (!reply.succeeded)
+    {
+        std::cerr << input << ": " << reply.data << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream out(output, std::ios::binary);
+    out << reply.data;
+    if (!out)
+    {
+        std::cerr << output << ": unable to write file" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void print_remarks(const char * input, const lcc::session & session)
+{
+    for (const auto & remark : session.remarks)
+        std::cerr << input << ": remark: " << remark << std::endl;
+}
+
+int compile_local(const char * input, const char * output, lcc::FileType type,
+                  const lcc::Options & options, bool run, utils::profiler * profiler)
+{
+    lcc::session session(options);
+    session.codegen.profiler = profiler;
+
+    std::ifstream in(input);
+    try
+    {
+        if (run)
+        {
+            int result = session.run(in, input);
+            print_remarks(input, session);
+            return result;
+        }
+
+        std::error_code err;
+        llvm::raw_fd_ostream out(output, err, llvm::sys::fs::OpenFlags::F_None);
+        if (err)
+        {
+            std::cerr << output << ": " << err.message() << std::endl;
+            return EXIT_FAILURE;
+        }
+        session.compile(in, out, input, type);
+        print_remarks(input, session);
+        return EXIT_SUCCESS;
+    }
+    catch (const std::exception & e)
+    {
+        std::cerr << input << ": " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
+
+int report(const utils::profiler * profiler, bool time_report, const char * trace_file, int result)
+{
+    if (!profiler)
+        return result;
+
+    if (time_report)
+        profiler->write_report(std::cerr);
+    if (trace_file)
+    {
+        std::ofstream trace(trace_file);
+        profiler->write_trace(trace);
+        if (!trace)
+        {
+            std::cerr << trace_file << ": unable to write file" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char ** argv)
+{
+    lcc::Options options;
+    lcc::FileType type = lcc::FileType::LLVM;
+    bool run = false;
+    bool time_report = false;
+    const char * trace_file = nullptr;
+    unsigned jobs = 0;
+    const char * server_socket = nullptr;
+    const char * client_socket = nullptr;
+    std::vector<const char *> files;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if (arg.compare(0, 2, "-O") == 0)
+        {
+            lcc::Options level = parse_optimisations(argv[0], arg.substr(2));
+            options.opt = level.opt;
+            options.size_level = level.size_level;
+        }
+        else if (arg.compare(0, 7, "--emit=") == 0)
+            type = parse_file_type(argv[0], arg.substr(7));
+        else if (arg == "--incremental")
+            options.incremental = true;
+        else if (arg == "--binary-io")
+            options.binary_io = true;
+        else if (arg == "-g")
+            options.debug_info = true;
+        else if (arg == "-fno-omit-frame-pointer")
+            options.frame_pointer = true;
+        else if (arg == "-fmemoise")
+            options.memoise = true;
+        else if (arg == "--run")
+            run = true;
+        else if (arg == "--time-report")
+            time_report = true;
+        else if (arg.compare(0, 8, "--trace=") == 0)
+            trace_file = argv[i] + 8;
+        else if (arg == "--server" || arg == "--connect")
         {
-            case '0':
-                opt = lcc::Optimisations::NONE;
-                break;
-            case '1':
-                opt = lcc::Optimisations::TCO;
-                break;
-            case '2':
-                opt = lcc::Optimisations::TCO;
-                break;
-            default:
+            if (++i == argc)
                 usage(argv[0]);
+            (arg == "--server" ? server_socket : client_socket) = argv[i];
         }
+        else if (arg == "-j")
+        {
+            if (++i == argc)
+                usage(argv[0]);
+            jobs = parse_jobs(argv[0], argv[i]);
+        }
+        else if (arg.compare(0, 2, "-j") == 0)
+            jobs = parse_jobs(argv[0], arg.substr(2));
+        else if (arg[0] == '-')
+            usage(argv[0]);
+        else
+            files.push_back(argv[i]);
+    }
 
-        if (argc != 4)
+    if (server_socket)
+    {
+        if (!files.empty())
             usage(argv[0]);
 
-        input = argv[2];
-        output = argv[3];
+        lcc::serve(server_socket);
+        return EXIT_SUCCESS;
     }
 
-    std::ifstream in(input);
-    std::error_code err;
-    llvm::raw_fd_ostream out(output, err, llvm::sys::fs::OpenFlags::F_None);
-    lcc::compile_llvm(in, out, input, opt);
+    std::unique_ptr<utils::profiler> profiler;
+    if (time_report || trace_file)
+        profiler.reset(new utils::profiler());
+
+    if (run)
+    {
+        if (files.size() != 1)
+            usage(argv[0]);
+
+        int result = compile_local(files[0], nullptr, type, options, true, profiler.get());
+        return report(profiler.get(), time_report, trace_file, result);
+    }
+
+    if (jobs)
+    {
+        if (files.empty())
+            usage(argv[0]);
+
+        int result = compile_files(files, type, options, jobs, profiler.get());
+        return report(profiler.get(), time_report, trace_file, result);
+    }
+
+    if (files.size() != 2)
+        usage(argv[0]);
+
+    const char * input = files[0];
+    const char * output = files[1];
+
+    if (client_socket)
+        return compile_remote(client_socket, input, output, type, options);
+
+    int result = compile_local(input, output, type, options, false, profiler.get());
+    return report(profiler.get(), time_report, trace_file, result);
 }
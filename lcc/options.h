@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+
+namespace lcc
+{
+enum class Optimisations
+{
+    NONE,
+    TCO,
+    ACC,
+    AGGRESSIVE
+};
+
+struct Options
+{
+    Options(Optimisations opt = Optimisations::ACC, unsigned size_level = 0)
+        : opt(opt)
+        , size_level(size_level)
+        , incremental(false)
+        , binary_io(false)
+        , debug_info(false)
+        , frame_pointer(false)
+        , memoise(false)
+    {}
+
+    Optimisations opt;
+    /* 0 for speed, 1 for -Os, 2 for -Oz */
+    unsigned size_level;
+    /* Cache optimised code per function, at the cost of inlining across functions */
+    bool incremental;
+    /* read and write use raw little endian 8 byte integers instead of text */
+    bool binary_io;
+    /* -g: DWARF line tables and variables */
+    bool debug_info;
+    /* Keep frame pointers for profilers walking the stack */
+    bool frame_pointer;
+    /* -fmemoise: pure recursive functions keep their results in memo tables */
+    bool memoise;
+};
+
+/* Identifies options affecting compilation output, e.g. for caching */
+inline std::string to_string(const Options & options)
+{
+    return "O" + std::to_string(static_cast<int>(options.opt))
+        + "s" + std::to_string(options.size_level)
+        + (options.incremental ? "i" : "")
+        + (options.binary_io ? "b" : "")
+        + (options.debug_info ? "g" : "")
+        + (options.frame_pointer ? "f" : "")
+        + (options.memoise ? "m" : "");
+}
+}
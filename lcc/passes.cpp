@@ -0,0 +1,96 @@
+#include "passes.h"
+#include "devirtualise.h"
+#include "alias.h"
+
+#include <llvm/ADT/Triple.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+
+#include <stdexcept>
+
+unsigned lcc::llvm_opt_level(Optimisations opt)
+{
+    switch (opt)
+    {
+        case Optimisations::NONE:
+            return 0;
+        case Optimisations::TCO:
+            return 1;
+        case Optimisations::ACC:
+            return 2;
+        case Optimisations::AGGRESSIVE:
+            return 3;
+    }
+
+    throw std::runtime_error("unknown optimisation level");
+}
+
+llvm::CodeGenOpt::Level lcc::codegen_opt_level(Optimisations opt)
+{
+    switch (opt)
+    {
+        case Optimisations::NONE:
+            return llvm::CodeGenOpt::None;
+        case Optimisations::TCO:
+            return llvm::CodeGenOpt::Less;
+        case Optimisations::ACC:
+            return llvm::CodeGenOpt::Default;
+        case Optimisations::AGGRESSIVE:
+            return llvm::CodeGenOpt::Aggressive;
+    }
+
+    throw std::runtime_error("unknown optimisation level");
+}
+
+void lcc::optimise_module(llvm::Module & module, llvm::TargetMachine & machine, const Options & options,
+                          utils::profiler * profiler)
+{
+    unsigned level = llvm_opt_level(options.opt);
+    if (level == 0)
+        return;
+
+    {
+        /* Before the pipeline, so that its inliner sees the direct calls */
+        utils::profiler::scope timer(profiler, "devirtualise", utils::profiler::kind::SPAN);
+        devirtualise_calls(module, !options.incremental);
+    }
+    {
+        utils::profiler::scope timer(profiler, "argument attributes", utils::profiler::kind::SPAN);
+        infer_argument_attributes(module, !options.incremental);
+    }
+
+    llvm::PassManagerBuilder builder;
+    builder.OptLevel = level;
+    builder.SizeLevel = options.size_level;
+    if (level > 1)
+        builder.Inliner = llvm::createFunctionInliningPass(level, options.size_level);
+    else
+        builder.Inliner = llvm::createAlwaysInlinerPass();
+    builder.LoopVectorize = level > 1 && options.size_level < 2;
+    builder.SLPVectorize = level > 1 && options.size_level < 2;
+
+    llvm::legacy::FunctionPassManager function_passes(&module);
+    function_passes.add(llvm::createTargetTransformInfoWrapperPass(machine.getTargetIRAnalysis()));
+    builder.populateFunctionPassManager(function_passes);
+
+    llvm::legacy::PassManager module_passes;
+    module_passes.add(new llvm::TargetLibraryInfoWrapperPass(llvm::Triple(module.getTargetTriple())));
+    module_passes.add(llvm::createTargetTransformInfoWrapperPass(machine.getTargetIRAnalysis()));
+    builder.populateModulePassManager(module_passes);
+
+    function_passes.doInitialization();
+    for (llvm::Function & f : module)
+    {
+        if (f.isDeclaration())
+            continue;
+        utils::profiler::scope timer(profiler, "optimise " + f.getName().str(), utils::profiler::kind::SPAN);
+        function_passes.run(f);
+    }
+    function_passes.doFinalization();
+
+    utils::profiler::scope timer(profiler, "module passes", utils::profiler::kind::SPAN);
+    module_passes.run(module);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "options.h"
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <utils/profiler.h>
+
+namespace lcc
+{
+unsigned llvm_opt_level(Optimisations opt);
+llvm::CodeGenOpt::Level codegen_opt_level(Optimisations opt);
+
+void optimise_module(llvm::Module & module, llvm::TargetMachine & machine, const Options & options,
+                     utils::profiler * profiler = nullptr);
+}
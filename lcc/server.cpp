@@ -0,0 +1,337 @@
+#include "server.h"
+#include "session.h"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+/*
+ * Every message is a fixed size header followed by its payload.
+ * Both ends live on the same machine, so integers are sent in
+ * host byte order.
+ */
+const std::uint32_t request_magic = 0x6c636372;     // "lccr"
+const std::uint32_t reply_magic = 0x6c636361;       // "lcca"
+
+const std::uint8_t incremental_flag = 1;
+const std::uint8_t binary_io_flag = 2;
+const std::uint8_t debug_info_flag = 4;
+const std::uint8_t frame_pointer_flag = 8;
+const std::uint8_t memoise_flag = 16;
+
+/* A client that stalls for longer than this is disconnected */
+const time_t connection_timeout = 30;
+
+/* Every session owns a context and a target machine, keep only a few */
+const std::size_t max_sessions = 8;
+const std::uint8_t max_size_level = 2;
+
+struct request_header
+{
+    std::uint32_t magic;
+    std::uint8_t opt;
+    std::uint8_t size_level;
+    std::uint8_t file_type;
+    std::uint8_t flags;
+    std::uint64_t name_size;
+    std::uint64_t source_size;
+};
+
+struct reply_header
+{
+    std::uint32_t magic;
+    std::uint32_t succeeded;
+    std::uint64_t size;
+};
+
+std::runtime_error system_error(const std::string & what)
+{
+    return std::runtime_error(what + ": " + strerror(errno));
+}
+
+struct socket_fd
+{
+    socket_fd(int fd)
+        : fd(fd)
+    {
+        if (fd == -1)
+            throw system_error("socket");
+    }
+
+    socket_fd(const socket_fd &) = delete;
+    socket_fd & operator=(const socket_fd &) = delete;
+
+    ~socket_fd()
+    {
+        close(fd);
+    }
+
+    int fd;
+};
+
+sockaddr_un socket_address(const std::string & path)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("socket path is too long: " + path);
+    std::strcpy(address.sun_path, path.c_str());
+    return address;
+}
+
+/* Returns false if the peer closed connection before sending anything */
+bool full_read(int fd, void * buf, std::size_t count)
+{
+    char * ptr = static_cast<char *>(buf);
+    std::size_t done = 0;
+    while (done < count)
+    {
+        ssize_t r = ::read(fd, ptr + done, count - done);
+        if (r == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                throw std::runtime_error("connection timed out");
+            throw system_error("read");
+        }
+        if (r == 0)
+        {
+            if (done == 0)
+                return false;
+            throw std::runtime_error("connection closed in the middle of message");
+        }
+        done += r;
+    }
+    return true;
+}
+
+void full_write(int fd, const void * buf, std::size_t count)
+{
+    const char * ptr = static_cast<const char *>(buf);
+    while (count > 0)
+    {
+        ssize_t r = ::send(fd, ptr, count, MSG_NOSIGNAL);
+        if (r == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                throw std::runtime_error("connection timed out");
+            throw system_error("write");
+        }
+        count -= r;
+        ptr += r;
+    }
+}
+
+std::string read_string(int fd, std::uint64_t size)
+{
+    std::string result(size, '\0');
+    if (size && !full_read(fd, &result[0], size))
+        throw std::runtime_error("connection closed in the middle of message");
+    return result;
+}
+
+void set_timeouts(int fd)
+{
+    timeval timeout{connection_timeout, 0};
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1
+        || setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == -1)
+        throw system_error("setsockopt");
+}
+
+/* Session is not thread safe, connections take turns to use it */
+struct shared_session
+{
+    explicit shared_session(const lcc::Options & options)
+        : s(options)
+    {}
+
+    std::mutex lock;
+    lcc::session s;
+};
+
+/*
+ * Connections are served concurrently, each on its own thread, so
+ * that a slow client only holds up itself. Requests are read outside
+ * of any lock, only compiling with the same options is serialised.
+ */
+struct server
+{
+    std::shared_ptr<shared_session> get_session(const lcc::Options & options)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        std::string key = to_string(options);
+        auto it = sessions.find(key);
+        if (it == sessions.end())
+        {
+            /* Sessions still in use are kept alive by their connections */
+            if (sessions.size() >= max_sessions)
+                sessions.clear();
+            it = sessions.emplace(key, std::make_shared<shared_session>(options)).first;
+        }
+        return it->second;
+    }
+
+    lcc::compile_reply compile(const request_header & header, const std::string & name, const std::string & source)
+    {
+        if (header.opt > static_cast<std::uint8_t>(lcc::Optimisations::AGGRESSIVE)
+            || header.size_level > max_size_level
+            || header.file_type > static_cast<std::uint8_t>(lcc::FileType::OBJECT))
+            return {false, "malformed compile request"};
+
+        lcc::Options options(static_cast<lcc::Optimisations>(header.opt), header.size_level);
+        options.incremental = header.flags & incremental_flag;
+        options.binary_io = header.flags & binary_io_flag;
+        options.debug_info = header.flags & debug_info_flag;
+        options.frame_pointer = header.flags & frame_pointer_flag;
+        options.memoise = header.flags & memoise_flag;
+        lcc::FileType type = static_cast<lcc::FileType>(header.file_type);
+        try
+        {
+            std::istringstream in(source);
+            llvm::SmallString<0> buffer;
+            {
+                std::shared_ptr<shared_session> session = get_session(options);
+                std::lock_guard<std::mutex> guard(session->lock);
+                llvm::raw_svector_ostream out(buffer);
+                session->s.compile(in, out, name, type);
+            }
+            return {true, buffer.str().str()};
+        }
+        catch (const std::exception & e)
+        {
+            return {false, e.what()};
+        }
+    }
+
+    void handle(int fd)
+    {
+        request_header header;
+        while (full_read(fd, &header, sizeof(header)))
+        {
+            if (header.magic != request_magic)
+                throw std::runtime_error("unknown request");
+
+            std::string name = read_string(fd, header.name_size);
+            std::string source = read_string(fd, header.source_size);
+            lcc::compile_reply reply = compile(header, name, source);
+
+            reply_header response{reply_magic, reply.succeeded, reply.data.size()};
+            full_write(fd, &response, sizeof(response));
+            full_write(fd, reply.data.data(), reply.data.size());
+        }
+    }
+
+    std::mutex lock;
+    std::map<std::string, std::shared_ptr<shared_session>> sessions;
+};
+}
+
+void lcc::serve(const std::string & socket_path)
+{
+    initialise_target();
+
+    socket_fd listener(socket(AF_UNIX, SOCK_STREAM, 0));
+    sockaddr_un address = socket_address(socket_path);
+    /* Only replace a socket left behind by a previous server */
+    struct stat status;
+    if (lstat(socket_path.c_str(), &status) == 0)
+    {
+        if (!S_ISSOCK(status.st_mode))
+            throw std::runtime_error(socket_path + " exists and is not a socket");
+        if (unlink(socket_path.c_str()) == -1)
+            throw system_error("unlink " + socket_path);
+    }
+    else if (errno != ENOENT)
+        throw system_error("stat " + socket_path);
+    if (bind(listener.fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1)
+        throw system_error("bind");
+    if (listen(listener.fd, SOMAXCONN) == -1)
+        throw system_error("listen");
+
+    server s;
+    while (true)
+    {
+        int fd = accept(listener.fd, nullptr, nullptr);
+        if (fd == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            throw system_error("accept");
+        }
+
+        try
+        {
+            std::thread([&s, fd] {
+                socket_fd connection(fd);
+                try
+                {
+                    set_timeouts(connection.fd);
+                    s.handle(connection.fd);
+                }
+                catch (const std::exception & e)
+                {
+                    std::cerr << "lcc server: " << e.what() << std::endl;
+                }
+            }).detach();
+        }
+        catch (const std::system_error & e)
+        {
+            close(fd);
+            std::cerr << "lcc server: " << e.what() << std::endl;
+        }
+    }
+}
+
+lcc::compile_reply lcc::request_compile(const std::string & socket_path,
+                                        const std::string & source,
+                                        const std::string & module_name,
+                                        FileType type, const Options & options)
+{
+    socket_fd connection(socket(AF_UNIX, SOCK_STREAM, 0));
+    sockaddr_un address = socket_address(socket_path);
+    if (connect(connection.fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1)
+        throw system_error("connect to " + socket_path);
+
+    request_header header{request_magic,
+                          static_cast<std::uint8_t>(options.opt),
+                          static_cast<std::uint8_t>(options.size_level),
+                          static_cast<std::uint8_t>(type),
+                          static_cast<std::uint8_t>((options.incremental ? incremental_flag : 0)
+                                                    | (options.binary_io ? binary_io_flag : 0)
+                                                    | (options.debug_info ? debug_info_flag : 0)
+                                                    | (options.frame_pointer ? frame_pointer_flag : 0)
+                                                    | (options.memoise ? memoise_flag : 0)),
+                          module_name.size(),
+                          source.size()};
+    full_write(connection.fd, &header, sizeof(header));
+    full_write(connection.fd, module_name.data(), module_name.size());
+    full_write(connection.fd, source.data(), source.size());
+
+    reply_header reply;
+    if (!full_read(connection.fd, &reply, sizeof(reply)) || reply.magic != reply_magic)
+        throw std::runtime_error("malformed reply from compile server");
+
+    return {reply.succeeded != 0, read_string(connection.fd, reply.size)};
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "options.h"
+#include "target.h"
+
+#include <string>
+
+namespace lcc
+{
+struct compile_reply
+{
+    bool succeeded;
+    /* Compiled file or diagnostics if compilation failed */
+    std::string data;
+};
+
+/*
+ * Compile server listening on a unix domain socket. Sessions, and so
+ * target machines, are cached between requests, one per set of
+ * options. Every connection is served on its own thread and dropped
+ * if the client stalls. Serves until the process is killed.
+ */
+void serve(const std::string & socket_path);
+
+compile_reply request_compile(const std::string & socket_path,
+                              const std::string & source,
+                              const std::string & module_name,
+                              FileType type, const Options & options);
+}
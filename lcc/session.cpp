@@ -0,0 +1,407 @@
+#include "session.h"
+#include "jit.h"
+#include "lcc.h"
+#include "link.h"
+#include "passes.h"
+
+#include <parse/parser.h>
+#include <parse/ast/l.h>
+#include <gen/gen.h>
+#include <sem/l.h>
+#include <optimise/l.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <boost/variant.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+/* Hash of the file contents, empty if it cannot be read */
+std::string file_hash(const std::string & filename)
+{
+    if (filename.empty())
+        return "";
+    auto buffer = llvm::MemoryBuffer::getFile(filename);
+    if (!buffer)
+        return "";
+    return lcc::compile_cache::key({buffer.get()->getBuffer()});
+}
+
+/*
+ * Identity of the compiler and runtime for cache keys: hashes of the
+ * running executable, the runtime library and its bitcode. A rebuilt
+ * lcc must not reuse results of the old one, computed once per process.
+ */
+const std::string & build_id()
+{
+    static const std::string id = []
+    {
+        // Any address in the executable, used if /proc/self/exe is not available
+        void * address = reinterpret_cast<void *>(reinterpret_cast<std::intptr_t>(&file_hash));
+        std::string executable = llvm::sys::fs::getMainExecutable(nullptr, address);
+        return lcc::compile_cache::key({LCC_VERSION,
+                                        file_hash(executable),
+                                        file_hash(lcc::runtime_library()),
+                                        file_hash(lcc::runtime_bitcode())});
+    }();
+    return id;
+}
+}
+
+lcc::session::session(const Options & options)
+    : options(options)
+    , machine(create_target_machine(codegen_opt_level(options.opt)))
+    , cache(compile_cache::from_environment())
+{
+    codegen.io = options.binary_io ? codegen::io_mode::BINARY : codegen::io_mode::TEXT;
+    codegen.emit_debug_info = options.debug_info;
+    codegen.frame_pointer = options.frame_pointer;
+    codegen.tail_calls = options.opt >= Optimisations::TCO;
+}
+
+std::unique_ptr<llvm::Module> lcc::session::compile_module(std::istream & in, const std::string & module_name)
+{
+    utils::profiler * profiler = codegen.profiler;
+    remarks.clear();
+
+    ast::Code code = [&]
+    {
+        utils::profiler::scope timer(profiler, "parse");
+        ast::parser p;
+        return p.parse(in);
+    }();
+    {
+        utils::profiler::scope timer(profiler, "semantic analysis");
+        sem::verify(code);
+    }
+    codegen::Code gen_code = [&]
+    {
+        utils::profiler::scope timer(profiler, "construct codegen ast");
+        return codegen::Code(code);
+    }();
+    if (options.opt > Optimisations::NONE)
+    {
+        utils::profiler::scope timer(profiler, "inlining");
+        optimise::inline_functions(gen_code);
+    }
+    {
+        utils::profiler::scope timer(profiler, "constant propagation");
+        optimise::propagate_constants(gen_code);
+    }
+    if (options.opt >= Optimisations::ACC)
+    {
+        utils::profiler::scope timer(profiler, "accumulator optimisation");
+        optimise::optimise_to_accum(gen_code);
+    }
+    if (options.opt >= Optimisations::TCO)
+    {
+        utils::profiler::scope timer(profiler, "tail call optimisation");
+        optimise::optimise_tail_call(gen_code);
+    }
+    if (options.opt > Optimisations::NONE || options.memoise)
+    {
+        utils::profiler::scope timer(profiler, "effect analysis");
+        optimise::analyse_effects(gen_code);
+    }
+    if (options.memoise)
+    {
+        utils::profiler::scope timer(profiler, "memoisation");
+        for (const auto & name : optimise::memoise_functions(gen_code))
+            remarks.push_back("memoised function '" + name + "'");
+        optimise::analyse_effects(gen_code);
+    }
+    return generate_module(gen_code, module_name);
+}
+
+std::unique_ptr<llvm::Module> lcc::session::generate_module(const codegen::Code & code, const std::string & module_name)
+{
+    if (!options.incremental || !cache)
+    {
+        std::unique_ptr<llvm::Module> module = [&]
+        {
+            utils::profiler::scope timer(codegen.profiler, "generate");
+            return codegen::generate(codegen, code, module_name.c_str());
+        }();
+        configure_module(*module, *machine);
+        link_runtime(*module);
+        {
+            utils::profiler::scope timer(codegen.profiler, "llvm optimisation");
+            optimise_module(*module, *machine, options, codegen.profiler);
+        }
+        return module;
+    }
+
+    /*
+     * Every function is generated and optimised in a module of its own,
+     * which is cached by the function fingerprint. After an edit only the
+     * changed functions are generated again, the rest is linked from cache.
+     */
+    utils::profiler::scope timer(codegen.profiler, "incremental generate");
+    std::unique_ptr<llvm::Module> module = codegen::generate_variables(codegen, code, module_name.c_str());
+    configure_module(*module, *machine);
+
+    for (const auto & entry : code.entries)
+    {
+        const codegen::Function * function = boost::get<codegen::Function>(&entry.entry);
+        if (!function)
+            continue;
+
+        std::unique_ptr<llvm::Module> part = generate_function(code, *function, module_name);
+        if (llvm::Linker::LinkModules(module.get(), part.get()))
+            throw std::runtime_error("internal compiler error: unable to link function '" + function->name + "'");
+    }
+
+    return module;
+}
+
+std::unique_ptr<llvm::Module> lcc::session::generate_function(const codegen::Code & code,
+                                                              const codegen::Function & function,
+                                                              const std::string & module_name)
+{
+    // Debug information refers to the source file and lines, otherwise the module does not matter
+    std::string key = cache_key("function", options.debug_info ? module_name : "",
+                                codegen::fingerprint(code, function, options.debug_info));
+    std::string data;
+    if (cache->lookup(key, data))
+    {
+        auto part = llvm::parseBitcodeFile(llvm::MemoryBufferRef(data, module_name), codegen.context);
+        if (part)
+            return std::move(part.get());
+        // Unreadable entry, generate the function again and overwrite it
+    }
+
+    std::unique_ptr<llvm::Module> part = codegen::generate_function(codegen, code, function, module_name.c_str());
+    configure_module(*part, *machine);
+    link_runtime(*part);
+    optimise_module(*part, *machine, options, codegen.profiler);
+
+    llvm::SmallString<0> buffer;
+    {
+        llvm::raw_svector_ostream out(buffer);
+        llvm::WriteBitcodeToFile(part.get(), out);
+    }
+    cache->store(key, buffer.str());
+
+    return part;
+}
+
+void lcc::session::link_runtime(llvm::Module & module)
+{
+    /* Runtime I/O is only worth inlining into optimised code */
+    if (options.opt == Optimisations::NONE)
+        return;
+
+    std::string path = lcc::runtime_bitcode();
+    if (path.empty())
+        return;
+
+    if (!runtime_buffer)
+    {
+        auto buffer = llvm::MemoryBuffer::getFile(path);
+        if (!buffer)
+            throw std::runtime_error("unable to read runtime '" + path + "': " + buffer.getError().message());
+        runtime_buffer = std::move(buffer.get());
+    }
+
+    auto runtime = llvm::parseBitcodeFile(runtime_buffer->getMemBufferRef(), codegen.context);
+    if (!runtime)
+        throw std::runtime_error("unable to load runtime '" + path + "': " + runtime.getError().message());
+    configure_module(*runtime.get(), *machine);
+
+    std::vector<std::string> definitions;
+    for (const llvm::Function & f : *runtime.get())
+        if (!f.isDeclaration())
+            definitions.push_back(f.getName().str());
+
+    if (llvm::Linker::LinkModules(&module, runtime.get().get()))
+        throw std::runtime_error("internal compiler error: unable to link runtime '" + path + "'");
+
+    /* Every module gets its own copy, the native runtime has the exported one */
+    for (const auto & name : definitions)
+        if (llvm::Function * f = module.getFunction(name))
+            f->setLinkage(llvm::GlobalValue::InternalLinkage);
+}
+
+void lcc::session::compile_llvm(std::istream & in, llvm::raw_ostream & out, const std::string & module_name)
+{
+    compile_cached(in, out, module_name, FileType::LLVM);
+}
+
+void lcc::session::compile_bitcode(std::istream & in, llvm::raw_ostream & out, const std::string & module_name)
+{
+    compile_cached(in, out, module_name, FileType::BITCODE);
+}
+
+void lcc::session::compile_native(std::istream & in, llvm::raw_pwrite_stream & out,
+                                  const std::string & module_name, FileType type)
+{
+    if (type != FileType::ASSEMBLY && type != FileType::OBJECT)
+        throw std::runtime_error("file type cannot be emitted by target machine");
+    compile_cached(in, out, module_name, type);
+}
+
+void lcc::session::compile(std::istream & in, llvm::raw_pwrite_stream & out,
+                           const std::string & module_name, FileType type)
+{
+    compile_cached(in, out, module_name, type);
+}
+
+void lcc::session::compile_cached(std::istream & in, llvm::raw_ostream & out,
+                                  const std::string & module_name, FileType type)
+{
+    std::string source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::string key;
+    if (cache)
+    {
+        utils::profiler::scope timer(codegen.profiler, "cache lookup");
+        key = cache_key(std::to_string(static_cast<int>(type)), module_name, source);
+        std::string data;
+        if (cache->lookup(key, data))
+        {
+            lookup_remarks(key);
+            out << data;
+            return;
+        }
+    }
+
+    llvm::SmallString<0> buffer;
+    {
+        std::istringstream source_in(source);
+        llvm::raw_svector_ostream buffer_out(buffer);
+        std::unique_ptr<llvm::Module> module = compile_module(source_in, module_name);
+        write_module(*module, buffer_out, type);
+    }
+
+    if (cache)
+    {
+        store_remarks(key);
+        cache->store(key, buffer.str());
+    }
+    out << buffer.str();
+}
+
+void lcc::session::write_module(llvm::Module & module, llvm::raw_pwrite_stream & out, FileType type)
+{
+    utils::profiler::scope timer(codegen.profiler, "emit");
+    switch (type)
+    {
+        case FileType::LLVM:
+            module.print(out, nullptr);
+            return;
+        case FileType::BITCODE:
+            llvm::WriteBitcodeToFile(&module, out);
+            return;
+        case FileType::ASSEMBLY:
+        case FileType::OBJECT:
+            emit_native(module, *machine, out, type);
+            return;
+    }
+
+    throw std::runtime_error("unknown output file type");
+}
+
+std::string lcc::session::cache_key(llvm::StringRef kind, llvm::StringRef module_name, llvm::StringRef source) const
+{
+    return compile_cache::key({build_id(),
+                               machine->getTargetTriple().str(),
+                               machine->getTargetCPU(),
+                               to_string(options),
+                               kind,
+                               module_name,
+                               source});
+}
+
+/* Stored before the output, so a hit finds them unless they were evicted */
+void lcc::session::store_remarks(const std::string & key)
+{
+    if (remarks.empty())
+        return;
+
+    std::string data;
+    for (const auto & remark : remarks)
+        data += remark + "\n";
+    cache->store(compile_cache::key({key, "remarks"}), data);
+}
+
+void lcc::session::lookup_remarks(const std::string & key)
+{
+    remarks.clear();
+    std::string data;
+    if (!cache->lookup(compile_cache::key({key, "remarks"}), data))
+        return;
+
+    std::istringstream in(data);
+    std::string remark;
+    while (std::getline(in, remark))
+        remarks.push_back(remark);
+}
+
+int lcc::session::run(std::istream & in, const std::string & module_name)
+{
+    jit engine(create_target_machine(codegen_opt_level(options.opt)), codegen.context);
+    engine.add_module(compile_module(in, module_name));
+    utils::profiler::scope timer(codegen.profiler, "run");
+    return engine.run_main();
+}
+
+void lcc::session::compile_executable(std::istream & in, const std::string & module_name,
+                                      const std::string & output_name)
+{
+    if (!cache)
+    {
+        link_executable(in, module_name, output_name);
+        return;
+    }
+
+    // Module name only reaches the executable through debug info
+    std::string source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::string key = cache_key("executable", options.debug_info ? module_name : "", source);
+    if (cache->lookup_file(key, output_name))
+    {
+        lookup_remarks(key);
+        return;
+    }
+
+    std::istringstream source_in(source);
+    link_executable(source_in, module_name, output_name);
+    store_remarks(key);
+    cache->store_file(key, output_name);
+}
+
+void lcc::session::link_executable(std::istream & in, const std::string & module_name,
+                                   const std::string & output_name)
+{
+    std::string object_filename = create_temp_file("lcc_XXXXXX.o", 2);
+    {
+        std::error_code err;
+        llvm::raw_fd_ostream out(object_filename, err, llvm::sys::fs::OpenFlags::F_None);
+        if (err)
+            throw std::runtime_error("unable to open '" + object_filename + "': " + err.message());
+        std::unique_ptr<llvm::Module> module = compile_module(in, module_name);
+        write_module(*module, out, FileType::OBJECT);
+    }
+
+    try
+    {
+        utils::profiler::scope timer(codegen.profiler, "link");
+        lcc::link_executable({object_filename}, output_name);
+    }
+    catch (...)
+    {
+        std::remove(object_filename.c_str());
+        throw;
+    }
+
+    std::remove(object_filename.c_str());
+}
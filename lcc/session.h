@@ -0,0 +1,67 @@
+#pragma once
+
+#include "cache.h"
+#include "options.h"
+#include "target.h"
+
+#include <gen/ast/l.h>
+#include <gen/session.h>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lcc
+{
+/*
+ * Compiler instance owning all the LLVM state needed to compile
+ * programs: context, IR builder and target machine. Sessions are
+ * independent, so different threads can compile at the same time
+ * as long as each one uses its own session.
+ */
+struct session
+{
+    session(const Options & options = Options());
+
+    std::unique_ptr<llvm::Module> compile_module(std::istream & in, const std::string & module_name);
+    void compile_llvm(std::istream & in, llvm::raw_ostream & out, const std::string & module_name);
+    void compile_bitcode(std::istream & in, llvm::raw_ostream & out, const std::string & module_name);
+    void compile_native(std::istream & in, llvm::raw_pwrite_stream & out,
+                        const std::string & module_name, FileType type);
+    void compile(std::istream & in, llvm::raw_pwrite_stream & out,
+                 const std::string & module_name, FileType type);
+    int run(std::istream & in, const std::string & module_name);
+    void compile_executable(std::istream & in, const std::string & module_name, const std::string & output_name);
+
+    Options options;
+    codegen::session codegen;
+    std::unique_ptr<llvm::TargetMachine> machine;
+    std::unique_ptr<compile_cache> cache;
+    /*
+     * Notes on optimisations done by the last compilation, e.g. memoised
+     * functions. They are cached with the output and replayed on a hit.
+     */
+    std::vector<std::string> remarks;
+
+private:
+    void link_runtime(llvm::Module & module);
+    std::unique_ptr<llvm::Module> generate_module(const codegen::Code & code, const std::string & module_name);
+    std::unique_ptr<llvm::Module> generate_function(const codegen::Code & code, const codegen::Function & function,
+                                                    const std::string & module_name);
+    void compile_cached(std::istream & in, llvm::raw_ostream & out,
+                        const std::string & module_name, FileType type);
+    void write_module(llvm::Module & module, llvm::raw_pwrite_stream & out, FileType type);
+    void link_executable(std::istream & in, const std::string & module_name, const std::string & output_name);
+    std::string cache_key(llvm::StringRef kind, llvm::StringRef module_name, llvm::StringRef source) const;
+    void store_remarks(const std::string & key);
+    void lookup_remarks(const std::string & key);
+
+    std::unique_ptr<llvm::MemoryBuffer> runtime_buffer;
+};
+}
@@ -0,0 +1,72 @@
+#include "target.h"
+
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetOptions.h>
+
+#include <mutex>
+#include <stdexcept>
+
+void lcc::initialise_target()
+{
+    static std::once_flag initialised;
+    std::call_once(initialised, [] ()
+    {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+    });
+}
+
+std::unique_ptr<llvm::TargetMachine> lcc::create_target_machine(llvm::CodeGenOpt::Level level)
+{
+    initialise_target();
+
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    std::string error;
+    const llvm::Target * target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (!target)
+        throw std::runtime_error("unable to find target for '" + triple + "': " + error);
+
+    llvm::TargetOptions options;
+    llvm::TargetMachine * machine = target->createTargetMachine(
+            triple, llvm::sys::getHostCPUName(), "", options,
+            llvm::Reloc::Default, llvm::CodeModel::Default, level);
+    if (!machine)
+        throw std::runtime_error("unable to create target machine for '" + triple + "'");
+
+    return std::unique_ptr<llvm::TargetMachine>(machine);
+}
+
+void lcc::configure_module(llvm::Module & module, const llvm::TargetMachine & machine)
+{
+    module.setTargetTriple(machine.getTargetTriple().str());
+    module.setDataLayout(*machine.getDataLayout());
+}
+
+void lcc::emit_native(llvm::Module & module, llvm::TargetMachine & machine,
+                      llvm::raw_pwrite_stream & out, FileType type)
+{
+    llvm::TargetMachine::CodeGenFileType file_type;
+    switch (type)
+    {
+        case FileType::ASSEMBLY:
+            file_type = llvm::TargetMachine::CGFT_AssemblyFile;
+            break;
+        case FileType::OBJECT:
+            file_type = llvm::TargetMachine::CGFT_ObjectFile;
+            break;
+        default:
+            throw std::runtime_error("file type cannot be emitted by target machine");
+    }
+
+    configure_module(module, machine);
+
+    llvm::legacy::PassManager pm;
+    if (machine.addPassesToEmitFile(pm, out, file_type))
+        throw std::runtime_error("target machine cannot emit file of this type");
+    pm.run(module);
+    out.flush();
+}
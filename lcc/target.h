@@ -0,0 +1,27 @@
+#pragma once
+
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <memory>
+
+namespace lcc
+{
+enum class FileType
+{
+    LLVM,
+    BITCODE,
+    ASSEMBLY,
+    OBJECT
+};
+
+void initialise_target();
+std::unique_ptr<llvm::TargetMachine> create_target_machine(
+        llvm::CodeGenOpt::Level level = llvm::CodeGenOpt::Default);
+
+void configure_module(llvm::Module & module, const llvm::TargetMachine & machine);
+void emit_native(llvm::Module & module, llvm::TargetMachine & machine,
+                 llvm::raw_pwrite_stream & out, FileType type);
+}
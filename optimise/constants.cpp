@@ -0,0 +1,622 @@
+#include "l.h"
+
+#include <utils/fmap.h>
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <set>
+
+namespace optimise
+{
+namespace
+{
+using Constant = boost::variant<bool, std::int64_t>;
+
+/* What is known about a variable at one point of a function */
+struct Lattice
+{
+    enum State
+    {
+        /* Not assigned on any path yet, it may be taken to be anything */
+        UNDEFINED,
+        CONSTANT,
+        VARYING
+    };
+
+    bool operator==(const Lattice & other) const
+    {
+        return state == other.state && (state != CONSTANT || constant == other.constant);
+    }
+
+    State state;
+    Constant constant;
+};
+
+Lattice join(const Lattice & lhs, const Lattice & rhs)
+{
+    if (lhs.state == Lattice::UNDEFINED)
+        return rhs;
+    if (rhs.state == Lattice::UNDEFINED || lhs == rhs)
+        return lhs;
+    return {Lattice::VARYING, false};
+}
+
+/* Values of the tracked variables, on paths which can be taken */
+struct Environment
+{
+    bool operator==(const Environment & other) const
+    {
+        return reachable == other.reachable && (!reachable || values == other.values);
+    }
+
+    bool operator!=(const Environment & other) const
+    {
+        return !(*this == other);
+    }
+
+    bool reachable;
+    std::map<std::string, Lattice> values;
+};
+
+Environment join(const Environment & lhs, const Environment & rhs)
+{
+    if (!lhs.reachable)
+        return rhs;
+    if (!rhs.reachable)
+        return lhs;
+
+    Environment result(lhs);
+    for (auto & value : result.values)
+        value.second = join(value.second, rhs.values.at(value.first));
+    return result;
+}
+
+Environment unreachable()
+{
+    return {false, {}};
+}
+
+const Constant * get_constant(const ast::Expression & expr)
+{
+    const ast::Value * value = boost::get<ast::Value>(&expr.expression);
+    const ast::Const * constant = value ? boost::get<ast::Const>(&value->value) : nullptr;
+    return constant ? &constant->constant : nullptr;
+}
+
+const std::string * get_name(const ast::Expression & expr)
+{
+    const ast::Value * value = boost::get<ast::Value>(&expr.expression);
+    return value ? boost::get<std::string>(&value->value) : nullptr;
+}
+
+ast::Expression constant_expression(const Constant & constant)
+{
+    return ast::Value(ast::Const(constant));
+}
+
+/* Dropping the expression changes nothing but its value */
+bool is_pure(const ast::Expression & expr)
+{
+    const ast::BinOperator * op = boost::get<ast::BinOperator>(&expr.expression);
+    if (op)
+        return op->oper.oper != ast::Oper::DIV && op->oper.oper != ast::Oper::MOD
+            && is_pure(*op->lhs) && is_pure(*op->rhs);
+
+    const ast::Dereference * deref = boost::get<ast::Dereference>(&expr.expression);
+    if (deref)
+        return is_pure(*deref->expr);
+
+    return boost::get<ast::Value>(&expr.expression) || boost::get<ast::Address>(&expr.expression);
+}
+
+/* Signed overflow is undefined in lc (arithmetic is generated nsw), wrapping around is one result it permits */
+std::int64_t wrap(std::uint64_t value)
+{
+    return static_cast<std::int64_t>(value);
+}
+
+boost::optional<Constant> evaluate(ast::Oper::OperName oper, std::int64_t lhs, std::int64_t rhs)
+{
+    switch (oper)
+    {
+        case ast::Oper::PLUS:
+            return Constant(wrap(static_cast<std::uint64_t>(lhs) + static_cast<std::uint64_t>(rhs)));
+        case ast::Oper::MINUS:
+            return Constant(wrap(static_cast<std::uint64_t>(lhs) - static_cast<std::uint64_t>(rhs)));
+        case ast::Oper::MULT:
+            return Constant(wrap(static_cast<std::uint64_t>(lhs) * static_cast<std::uint64_t>(rhs)));
+        case ast::Oper::DIV:
+        case ast::Oper::MOD:
+            /* Left to trap at run time */
+            if (rhs == 0 || (lhs == std::numeric_limits<std::int64_t>::min() && rhs == -1))
+                return boost::none;
+            return Constant(oper == ast::Oper::DIV ? lhs / rhs : lhs % rhs);
+        case ast::Oper::GT:
+            return Constant(lhs > rhs);
+        case ast::Oper::LT:
+            return Constant(lhs < rhs);
+        case ast::Oper::EQ:
+            return Constant(lhs == rhs);
+        case ast::Oper::GE:
+            return Constant(lhs >= rhs);
+        case ast::Oper::LE:
+            return Constant(lhs <= rhs);
+        case ast::Oper::NE:
+            return Constant(lhs != rhs);
+        case ast::Oper::AND:
+        case ast::Oper::OR:
+            return boost::none;
+    }
+
+    return boost::none;
+}
+
+boost::optional<Constant> evaluate(ast::Oper::OperName oper, bool lhs, bool rhs)
+{
+    if (oper == ast::Oper::EQ)
+        return Constant(lhs == rhs);
+    if (oper == ast::Oper::NE)
+        return Constant(lhs != rhs);
+    return boost::none;
+}
+
+boost::optional<Constant> evaluate(ast::Oper::OperName oper, const Constant & lhs, const Constant & rhs)
+{
+    const std::int64_t * lhs_int = boost::get<std::int64_t>(&lhs);
+    const std::int64_t * rhs_int = boost::get<std::int64_t>(&rhs);
+    if (lhs_int && rhs_int)
+        return evaluate(oper, *lhs_int, *rhs_int);
+
+    const bool * lhs_bool = boost::get<bool>(&lhs);
+    const bool * rhs_bool = boost::get<bool>(&rhs);
+    if (lhs_bool && rhs_bool)
+        return evaluate(oper, *lhs_bool, *rhs_bool);
+
+    return boost::none;
+}
+
+bool is_int(const Constant * constant, std::int64_t value)
+{
+    const std::int64_t * i = constant ? boost::get<std::int64_t>(constant) : nullptr;
+    return i && *i == value;
+}
+
+ast::Expression binary(const ast::BinOperator & op, const ast::Expression & lhs, const ast::Expression & rhs)
+{
+    return ast::BinOperator{op.loc, std::make_shared<ast::Expression>(lhs), std::make_shared<ast::Expression>(rhs), op.oper};
+}
+
+/*
+ * `(x + c1) + c2` is `x + (c1 + c2)` and the same for `*`, `(x - c1) - c2`
+ * is `x - (c1 + c2)`. Only done if the constants do not overflow, then
+ * the result overflows exactly when the original expression does.
+ */
+boost::optional<ast::Expression> reassociate(const ast::BinOperator & op, const ast::Expression & lhs, std::int64_t rhs)
+{
+    const ast::BinOperator * inner = boost::get<ast::BinOperator>(&lhs.expression);
+    if (!inner || inner->oper.oper != op.oper.oper)
+        return boost::none;
+    if (op.oper.oper != ast::Oper::PLUS && op.oper.oper != ast::Oper::MULT && op.oper.oper != ast::Oper::MINUS)
+        return boost::none;
+
+    const Constant * inner_rhs = get_constant(*inner->rhs);
+    const Constant * inner_lhs = get_constant(*inner->lhs);
+    bool commutes = op.oper.oper != ast::Oper::MINUS;
+    const Constant * c = inner_rhs ? inner_rhs : commutes ? inner_lhs : nullptr;
+    const std::int64_t * c_int = c ? boost::get<std::int64_t>(c) : nullptr;
+    if (!c_int)
+        return boost::none;
+    const ast::Expression & x = c == inner_rhs ? *inner->lhs : *inner->rhs;
+
+    std::int64_t combined;
+    bool overflow = op.oper.oper == ast::Oper::MULT
+        ? __builtin_mul_overflow(*c_int, rhs, &combined)
+        : __builtin_add_overflow(*c_int, rhs, &combined);
+    if (overflow)
+        return boost::none;
+    return binary(op, x, constant_expression(Constant(combined)));
+}
+
+/*
+ * Constant propagation over the structured statements of one function.
+ * Only branches which can be taken are visited, so a variable assigned
+ * one constant on every path reaching a use is replaced by it. Loops
+ * are visited until the values at their entry do not change.
+ */
+struct Propagation
+{
+    Propagation(const std::map<std::string, Constant> & globals)
+        : globals(globals)
+    {}
+
+    ast::Expression fold(const ast::Value & expr, const Environment & env) const
+    {
+        const std::string * name = boost::get<std::string>(&expr.value);
+        if (!name)
+            return expr;
+
+        auto value = env.values.find(*name);
+        if (value != env.values.end() && value->second.state == Lattice::CONSTANT)
+            return constant_expression(value->second.constant);
+
+        auto global = globals.find(*name);
+        if (value == env.values.end() && global != globals.end())
+            return constant_expression(global->second);
+        return expr;
+    }
+
+    ast::Expression fold(const ast::BinOperator & expr, const Environment & env) const
+    {
+        ast::Expression lhs = fold(*expr.lhs, env);
+        const Constant * lhs_constant = get_constant(lhs);
+
+        /* The right hand side is evaluated depending on the left one */
+        if (expr.oper.oper == ast::Oper::AND || expr.oper.oper == ast::Oper::OR)
+        {
+            const bool * b = lhs_constant ? boost::get<bool>(lhs_constant) : nullptr;
+            if (b && *b == (expr.oper.oper == ast::Oper::OR))
+                return lhs;
+            if (b)
+                return fold(*expr.rhs, env);
+            return binary(expr, lhs, fold(*expr.rhs, env));
+        }
+
+        return simplify(expr, lhs, fold(*expr.rhs, env));
+    }
+
+    /* Operands are already folded */
+    ast::Expression simplify(const ast::BinOperator & expr, const ast::Expression & lhs, const ast::Expression & rhs) const
+    {
+        const Constant * lhs_constant = get_constant(lhs);
+        const Constant * rhs_constant = get_constant(rhs);
+        if (lhs_constant && rhs_constant)
+        {
+            boost::optional<Constant> result = evaluate(expr.oper.oper, *lhs_constant, *rhs_constant);
+            if (result)
+                return constant_expression(*result);
+        }
+
+        switch (expr.oper.oper)
+        {
+            case ast::Oper::PLUS:
+                if (is_int(lhs_constant, 0))
+                    return rhs;
+                if (is_int(rhs_constant, 0))
+                    return lhs;
+                break;
+            case ast::Oper::MINUS:
+                if (is_int(rhs_constant, 0))
+                    return lhs;
+                break;
+            case ast::Oper::MULT:
+                if (is_int(lhs_constant, 1))
+                    return rhs;
+                if (is_int(rhs_constant, 1))
+                    return lhs;
+                if ((is_int(lhs_constant, 0) && is_pure(rhs)) || (is_int(rhs_constant, 0) && is_pure(lhs)))
+                    return constant_expression(Constant(std::int64_t(0)));
+                break;
+            default:
+                break;
+        }
+
+        const std::int64_t * rhs_int = rhs_constant ? boost::get<std::int64_t>(rhs_constant) : nullptr;
+        if (rhs_int)
+        {
+            boost::optional<ast::Expression> result = reassociate(expr, lhs, *rhs_int);
+            if (result)
+                return *result;
+        }
+        /* Constants go to the right, where they are reassociated */
+        if (lhs_constant && !rhs_constant && (expr.oper.oper == ast::Oper::PLUS || expr.oper.oper == ast::Oper::MULT))
+            return simplify(expr, rhs, lhs);
+
+        return binary(expr, lhs, rhs);
+    }
+
+    ast::Expression fold(const ast::Dereference & expr, const Environment & env) const
+    {
+        return ast::Dereference{expr.loc, std::make_shared<ast::Expression>(fold(*expr.expr, env))};
+    }
+
+    /* `&x` stays, `&*p` has `p` folded */
+    ast::Expression fold(const ast::Address & expr, const Environment & env) const
+    {
+        const ast::Dereference * deref = boost::get<ast::Dereference>(&expr.expr->expression);
+        if (!deref)
+            return expr;
+        return ast::Address{expr.loc, std::make_shared<ast::Expression>(fold(*deref, env))};
+    }
+
+    ast::Expression fold(const ast::Call & expr, const Environment & env) const
+    {
+        std::list<ast::Expression> arguments;
+        for (const auto & arg : expr.arguments)
+            arguments.push_back(fold(arg, env));
+        return ast::Call{expr.loc, std::make_shared<ast::Expression>(fold(*expr.function, env)), arguments};
+    }
+
+    ast::Expression fold(const ast::Read & expr, const Environment &) const
+    {
+        return expr;
+    }
+
+    ast::Expression fold(const ast::Expression & expr, const Environment & env) const
+    {
+        ast::Expression result = fmap([&], x, this->fold(x, env), expr.expression);
+        if (!result.loc)
+            result.loc = expr.loc;
+        return result;
+    }
+
+    /* read(x) in an expression leaves x unknown */
+    void read_variables(const ast::Expression & expr, Environment & env) const
+    {
+        const ast::Read * read = boost::get<ast::Read>(&expr.expression);
+        const ast::BinOperator * op = boost::get<ast::BinOperator>(&expr.expression);
+        const ast::Dereference * deref = boost::get<ast::Dereference>(&expr.expression);
+        const ast::Address * addr = boost::get<ast::Address>(&expr.expression);
+        const ast::Call * call = boost::get<ast::Call>(&expr.expression);
+        if (read && env.values.count(read->varname))
+            env.values[read->varname] = {Lattice::VARYING, false};
+        if (op)
+        {
+            read_variables(*op->lhs, env);
+            read_variables(*op->rhs, env);
+        }
+        if (deref)
+            read_variables(*deref->expr, env);
+        if (addr)
+            read_variables(*addr->expr, env);
+        if (call)
+        {
+            read_variables(*call->function, env);
+            for (const auto & arg : call->arguments)
+                read_variables(arg, env);
+        }
+    }
+
+    ast::Expression evaluate_expression(const ast::Expression & expr, Environment & env) const
+    {
+        read_variables(expr, env);
+        return fold(expr, env);
+    }
+
+    void propagate(const ast::Assignment & st, Environment & env, std::list<codegen::Statement> & statements)
+    {
+        ast::Assignment result(st);
+        const std::string * name = get_name(st.lvalue);
+        if (!name)
+        {
+            read_variables(st.lvalue, env);
+            result.lvalue = fold(st.lvalue, env);
+        }
+        result.rvalue = evaluate_expression(st.rvalue, env);
+
+        if (name && env.values.count(*name))
+        {
+            const Constant * constant = get_constant(result.rvalue);
+            env.values[*name] = constant ? Lattice{Lattice::CONSTANT, *constant} : Lattice{Lattice::VARYING, false};
+        }
+        statements.push_back(codegen::Statement(result));
+    }
+
+    void propagate(const codegen::If & st, Environment & env, std::list<codegen::Statement> & statements)
+    {
+        codegen::If result(st);
+        result.condition = evaluate_expression(st.condition, env);
+
+        /* Only the branch taken remains */
+        const Constant * condition = get_constant(result.condition);
+        const bool * taken = condition ? boost::get<bool>(condition) : nullptr;
+        if (taken)
+        {
+            std::list<codegen::Statement> branch = propagate(*taken ? st.thenBody : st.elseBody, env);
+            statements.insert(statements.end(), branch.begin(), branch.end());
+            return;
+        }
+
+        Environment else_env = env;
+        result.thenBody = propagate(st.thenBody, env);
+        result.elseBody = propagate(st.elseBody, else_env);
+        env = join(env, else_env);
+        statements.push_back(codegen::Statement(result));
+    }
+
+    void propagate(const codegen::While & st, Environment & env, std::list<codegen::Statement> & statements)
+    {
+        codegen::While result(st);
+        read_variables(st.condition, env);
+        Environment entry = env;
+        while (true)
+        {
+            result.condition = fold(st.condition, entry);
+            const Constant * condition = get_constant(result.condition);
+            const bool * taken = condition ? boost::get<bool>(condition) : nullptr;
+
+            /* `while (false)` never runs its body */
+            if (taken && !*taken)
+            {
+                env = entry;
+                return;
+            }
+
+            Environment body_env = entry;
+            continues[st.label] = unreachable();
+            result.body = propagate(st.body, body_env);
+
+            Environment next = join(env, join(body_env, continues[st.label]));
+            if (next == entry)
+                break;
+            entry = next;
+        }
+
+        /* The loop is only left when its condition is false */
+        const Constant * condition = get_constant(result.condition);
+        env = condition ? unreachable() : entry;
+        statements.push_back(codegen::Statement(result));
+    }
+
+    void propagate(const codegen::Continue & st, Environment & env, std::list<codegen::Statement> & statements)
+    {
+        continues.at(st.label) = join(continues.at(st.label), env);
+        env = unreachable();
+        statements.push_back(codegen::Statement(st));
+    }
+
+    void propagate(const ast::Write & st, Environment & env, std::list<codegen::Statement> & statements)
+    {
+        statements.push_back(codegen::Statement(ast::Write{st.loc, evaluate_expression(st.expr, env)}));
+    }
+
+    void propagate(const ast::Return & st, Environment & env, std::list<codegen::Statement> & statements)
+    {
+        statements.push_back(codegen::Statement(ast::Return{st.loc, evaluate_expression(st.expr, env)}));
+        env = unreachable();
+    }
+
+    /* Statements after a return or continue are dropped */
+    std::list<codegen::Statement> propagate(const std::list<codegen::Statement> & statements, Environment & env)
+    {
+        std::list<codegen::Statement> result;
+        for (const auto & st : statements)
+        {
+            if (!env.reachable)
+                break;
+            fmap([&], x, this->propagate(x, env, result), st.statement);
+        }
+        return result;
+    }
+
+    const std::map<std::string, Constant> & globals;
+    /* Values at `continue` statements of the loops being visited */
+    std::map<std::string, Environment> continues;
+};
+
+/* Variables whose address is taken, and variables assigned or read into */
+struct Writes
+{
+    void collect(const ast::Expression & expr)
+    {
+        const ast::BinOperator * op = boost::get<ast::BinOperator>(&expr.expression);
+        const ast::Dereference * deref = boost::get<ast::Dereference>(&expr.expression);
+        const ast::Address * addr = boost::get<ast::Address>(&expr.expression);
+        const ast::Call * call = boost::get<ast::Call>(&expr.expression);
+        const ast::Read * read = boost::get<ast::Read>(&expr.expression);
+        if (op)
+        {
+            collect(*op->lhs);
+            collect(*op->rhs);
+        }
+        if (deref)
+            collect(*deref->expr);
+        if (addr)
+        {
+            const std::string * name = get_name(*addr->expr);
+            if (name)
+                address_taken.insert(*name);
+            collect(*addr->expr);
+        }
+        if (call)
+        {
+            collect(*call->function);
+            for (const auto & arg : call->arguments)
+                collect(arg);
+        }
+        if (read)
+            assigned.insert(read->varname);
+    }
+
+    void collect(const std::list<codegen::Statement> & statements)
+    {
+        for (const auto & st : statements)
+        {
+            const ast::Assignment * assignment = boost::get<ast::Assignment>(&st.statement);
+            const codegen::If * if_st = boost::get<codegen::If>(&st.statement);
+            const codegen::While * while_st = boost::get<codegen::While>(&st.statement);
+            const ast::Write * write = boost::get<ast::Write>(&st.statement);
+            const ast::Return * ret = boost::get<ast::Return>(&st.statement);
+            if (assignment)
+            {
+                const std::string * name = get_name(assignment->lvalue);
+                if (name)
+                    assigned.insert(*name);
+                collect(assignment->lvalue);
+                collect(assignment->rvalue);
+            }
+            if (if_st)
+            {
+                collect(if_st->condition);
+                collect(if_st->thenBody);
+                collect(if_st->elseBody);
+            }
+            if (while_st)
+            {
+                collect(while_st->condition);
+                collect(while_st->body);
+            }
+            if (write)
+                collect(write->expr);
+            if (ret)
+                collect(ret->expr);
+        }
+    }
+
+    std::set<std::string> address_taken;
+    std::set<std::string> assigned;
+};
+
+boost::optional<Constant> initial_value(const ast::Type & type)
+{
+    const ast::AtomType * atom = boost::get<ast::AtomType>(&type.type);
+    if (!atom)
+        return boost::none;
+    if (atom->type == ast::AtomType::BOOL)
+        return Constant(false);
+    return Constant(std::int64_t(0));
+}
+}
+
+void propagate_constants(codegen::Code & code)
+{
+    /* Globals start as 0 or false, those which are never changed stay so */
+    Writes writes;
+    for (const auto & entry : code.entries)
+    {
+        const codegen::Function * f = boost::get<codegen::Function>(&entry.entry);
+        if (f)
+            writes.collect(f->statements);
+    }
+
+    std::map<std::string, Constant> globals;
+    for (const auto & entry : code.entries)
+    {
+        const codegen::Variable * var = boost::get<codegen::Variable>(&entry.entry);
+        boost::optional<Constant> value = var ? initial_value(var->type) : boost::none;
+        if (value && !writes.assigned.count(var->name) && !writes.address_taken.count(var->name))
+            globals.emplace(var->name, *value);
+    }
+
+    for (auto & entry : code.entries)
+    {
+        codegen::Function * f = boost::get<codegen::Function>(&entry.entry);
+        if (!f)
+            continue;
+
+        /* Variables in memory may change through pointers, they are not tracked */
+        Writes locals;
+        locals.collect(f->statements);
+        Environment env{true, {}};
+        for (const auto & arg : f->arguments)
+            if (!locals.address_taken.count(arg.name) && initial_value(arg.type))
+                env.values[arg.name] = {Lattice::VARYING, false};
+        for (const auto & var : f->variables)
+            if (!locals.address_taken.count(var.name) && initial_value(var.type))
+                env.values[var.name] = {Lattice::UNDEFINED, false};
+
+        Propagation propagation(globals);
+        f->statements = propagation.propagate(f->statements, env);
+    }
+}
+}
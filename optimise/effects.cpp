@@ -0,0 +1,276 @@
+#include "l.h"
+
+#include <utils/fmap.h>
+
+#include <map>
+#include <set>
+
+namespace optimise
+{
+namespace
+{
+const std::string * get_name(const ast::Expression & expr)
+{
+    const ast::Value * v = boost::get<ast::Value>(&expr.expression);
+    return v ? boost::get<std::string>(&v->value) : nullptr;
+}
+
+/* Effects of one function body on its own, calls are only recorded */
+struct Body
+{
+    Body(const codegen::Function & f, const std::set<std::string> & globals,
+         const std::set<std::string> & functions, std::set<std::string> & address_taken)
+        : globals(globals)
+        , functions(functions)
+        , address_taken(address_taken)
+        , calls_pointer(false)
+    {
+        effects.reads_memory = false;
+        effects.writes_memory = false;
+        effects.io = false;
+        effects.recursive = false;
+        /* Memo tables are global */
+        if (f.memoise)
+        {
+            effects.reads_memory = true;
+            effects.writes_memory = true;
+        }
+
+        for (const auto & arg : f.arguments)
+            locals.insert(arg.name);
+        for (const auto & var : f.variables)
+            locals.insert(var.name);
+        for (const auto & st : f.statements)
+            this->collect(st);
+    }
+
+    bool is_global(const std::string & name) const
+    {
+        return !locals.count(name) && globals.count(name);
+    }
+
+    bool is_function(const std::string & name) const
+    {
+        return !locals.count(name) && functions.count(name);
+    }
+
+    void collect(const ast::Const &)
+    { }
+
+    void collect(const std::string & name)
+    {
+        if (is_global(name))
+            effects.reads_memory = true;
+        /* A function used as a value can be called through a pointer */
+        if (is_function(name))
+            address_taken.insert(name);
+    }
+
+    void collect(const ast::Value & expr)
+    {
+        fmap([this], x, this->collect(x), expr.value);
+    }
+
+    void collect(const ast::BinOperator & expr)
+    {
+        this->collect(*expr.lhs);
+        this->collect(*expr.rhs);
+    }
+
+    void collect(const ast::Dereference & expr)
+    {
+        this->collect(*expr.expr);
+        effects.reads_memory = true;
+    }
+
+    /* Address of a variable or of a dereferenced pointer, nothing is read from it */
+    void collect_address(const ast::Expression & expr)
+    {
+        const std::string * name = get_name(expr);
+        const ast::Dereference * deref = boost::get<ast::Dereference>(&expr.expression);
+        if (name && is_function(*name))
+            address_taken.insert(*name);
+        else if (deref)
+            this->collect(*deref->expr);
+        else if (!name)
+            this->collect(expr);
+    }
+
+    void collect(const ast::Address & expr)
+    {
+        collect_address(*expr.expr);
+    }
+
+    void collect(const ast::Call & expr)
+    {
+        const std::string * name = get_name(*expr.function);
+        if (name && is_function(*name))
+            callees.insert(*name);
+        else
+        {
+            /* Calling through `*p` reads p, not the memory it points to */
+            const ast::Dereference * deref = boost::get<ast::Dereference>(&expr.function->expression);
+            calls_pointer = true;
+            this->collect(deref ? *deref->expr : *expr.function);
+        }
+
+        for (const auto & arg : expr.arguments)
+            this->collect(arg);
+    }
+
+    void collect(const ast::Read & expr)
+    {
+        effects.io = true;
+        if (is_global(expr.varname))
+            effects.writes_memory = true;
+    }
+
+    void collect(const ast::Expression & expr)
+    {
+        fmap([this], x, this->collect(x), expr.expression);
+    }
+
+    void collect(const ast::Assignment & st)
+    {
+        const std::string * name = get_name(st.lvalue);
+        if (name)
+        {
+            if (is_global(*name))
+                effects.writes_memory = true;
+        }
+        else
+        {
+            collect_address(st.lvalue);
+            effects.writes_memory = true;
+        }
+        this->collect(st.rvalue);
+    }
+
+    void collect(const codegen::If & st)
+    {
+        this->collect(st.condition);
+        for (const auto & s : st.thenBody)
+            this->collect(s);
+        for (const auto & s : st.elseBody)
+            this->collect(s);
+    }
+
+    void collect(const codegen::While & st)
+    {
+        this->collect(st.condition);
+        for (const auto & s : st.body)
+            this->collect(s);
+    }
+
+    void collect(const codegen::Continue &)
+    { }
+
+    void collect(const ast::Write & st)
+    {
+        effects.io = true;
+        this->collect(st.expr);
+    }
+
+    void collect(const ast::Return & st)
+    {
+        this->collect(st.expr);
+    }
+
+    void collect(const codegen::Statement & st)
+    {
+        fmap([this], x, this->collect(x), st.statement);
+    }
+
+    const std::set<std::string> & globals;
+    const std::set<std::string> & functions;
+    std::set<std::string> & address_taken;
+    std::set<std::string> locals;
+
+    codegen::Effects effects;
+    std::set<std::string> callees;
+    bool calls_pointer;
+};
+
+bool reaches(const std::map<std::string, Body> & bodies, const std::string & from, const std::string & to)
+{
+    std::set<std::string> visited;
+    std::list<std::string> pending = {from};
+    while (!pending.empty())
+    {
+        std::string name = pending.front();
+        pending.pop_front();
+        for (const auto & callee : bodies.at(name).callees)
+        {
+            if (callee == to)
+                return true;
+            if (visited.insert(callee).second)
+                pending.push_back(callee);
+        }
+    }
+    return false;
+}
+}
+
+void analyse_effects(codegen::Code & code)
+{
+    std::set<std::string> globals, functions, address_taken;
+    for (const auto & entry : code.entries)
+    {
+        const codegen::Variable * var = boost::get<codegen::Variable>(&entry.entry);
+        const codegen::Function * f = boost::get<codegen::Function>(&entry.entry);
+        if (var)
+            globals.insert(var->name);
+        else
+            functions.insert(f->name);
+    }
+
+    std::map<std::string, Body> bodies;
+    for (const auto & entry : code.entries)
+    {
+        const codegen::Function * f = boost::get<codegen::Function>(&entry.entry);
+        if (f)
+            bodies.emplace(f->name, Body(*f, globals, functions, address_taken));
+    }
+
+    /* Function pointers in lc only come from '&', so they point to functions whose address is taken */
+    for (auto & body : bodies)
+        if (body.second.calls_pointer)
+            body.second.callees.insert(address_taken.begin(), address_taken.end());
+
+    for (auto & body : bodies)
+        body.second.effects.recursive = reaches(bodies, body.first, body.first);
+
+    /* Callees' effects are added until nothing changes, recursion makes this a fixpoint */
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (auto & body : bodies)
+        {
+            codegen::Effects & effects = body.second.effects;
+            for (const auto & callee : body.second.callees)
+            {
+                const codegen::Effects & other = bodies.at(callee).effects;
+                codegen::Effects merged = effects;
+                merged.reads_memory |= other.reads_memory;
+                merged.writes_memory |= other.writes_memory;
+                merged.io |= other.io;
+                if (merged.reads_memory != effects.reads_memory
+                        || merged.writes_memory != effects.writes_memory
+                        || merged.io != effects.io)
+                {
+                    effects = merged;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (auto & entry : code.entries)
+    {
+        codegen::Function * f = boost::get<codegen::Function>(&entry.entry);
+        if (f)
+            f->effects = bodies.at(f->name).effects;
+    }
+}
+}
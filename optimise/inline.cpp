@@ -0,0 +1,710 @@
+#include "l.h"
+#include "rename.h"
+
+#include <utils/fmap.h>
+
+#include <boost/optional.hpp>
+
+#include <map>
+#include <set>
+
+namespace optimise
+{
+namespace
+{
+/*
+ * Sizes are counted in AST nodes. A call is inlined when the callee is
+ * not bigger than the budget of the call site: calls in loops are worth
+ * more, and the only call of a function does not duplicate any code.
+ */
+const std::size_t inline_budget = 25;
+const std::size_t loop_inline_budget = 100;
+const std::size_t single_call_budget = 400;
+/* A constant argument lets code depending on it be folded */
+const std::size_t constant_argument_bonus = 10;
+/* Functions do not grow beyond this by inlining */
+const std::size_t max_function_size = 4000;
+
+std::size_t size(const ast::Expression & expr);
+
+std::size_t size(const ast::Value &)
+{
+    return 1;
+}
+
+std::size_t size(const ast::BinOperator & expr)
+{
+    return 1 + size(*expr.lhs) + size(*expr.rhs);
+}
+
+std::size_t size(const ast::Dereference & expr)
+{
+    return 1 + size(*expr.expr);
+}
+
+std::size_t size(const ast::Address & expr)
+{
+    return 1 + size(*expr.expr);
+}
+
+std::size_t size(const ast::Call & expr)
+{
+    std::size_t result = 1 + size(*expr.function);
+    for (const auto & arg : expr.arguments)
+        result += size(arg);
+    return result;
+}
+
+std::size_t size(const ast::Read &)
+{
+    return 1;
+}
+
+std::size_t size(const ast::Expression & expr)
+{
+    return fmap([], x, size(x), expr.expression);
+}
+
+std::size_t size(const std::list<codegen::Statement> & statements);
+
+std::size_t size(const ast::Assignment & st)
+{
+    return 1 + size(st.lvalue) + size(st.rvalue);
+}
+
+std::size_t size(const codegen::If & st)
+{
+    return 1 + size(st.condition) + size(st.thenBody) + size(st.elseBody);
+}
+
+std::size_t size(const codegen::While & st)
+{
+    return 1 + size(st.condition) + size(st.body);
+}
+
+std::size_t size(const codegen::Continue &)
+{
+    return 1;
+}
+
+std::size_t size(const ast::Write & st)
+{
+    return 1 + size(st.expr);
+}
+
+std::size_t size(const ast::Return & st)
+{
+    return 1 + size(st.expr);
+}
+
+std::size_t size(const std::list<codegen::Statement> & statements)
+{
+    std::size_t result = 0;
+    for (const auto & st : statements)
+        result += fmap([], x, size(x), st.statement);
+    return result;
+}
+
+const std::string * called_name(const ast::Call & call)
+{
+    const ast::Value * value = boost::get<ast::Value>(&call.function->expression);
+    return value ? boost::get<std::string>(&value->value) : nullptr;
+}
+
+/* Whether control never reaches the end of the statements */
+bool terminates(const std::list<codegen::Statement> & statements)
+{
+    if (statements.empty())
+        return false;
+
+    const codegen::Statement & last = statements.back();
+    if (boost::get<ast::Return>(&last.statement) || boost::get<codegen::Continue>(&last.statement))
+        return true;
+
+    const codegen::If * if_st = boost::get<codegen::If>(&last.statement);
+    return if_st && terminates(if_st->thenBody) && terminates(if_st->elseBody);
+}
+
+/*
+ * `if (c) return a; rest` becomes `if (c) return a; else rest`, so that
+ * the returns of a typical function body are the last thing it does.
+ */
+std::list<codegen::Statement> nest_returns(const std::list<codegen::Statement> & statements)
+{
+    std::list<codegen::Statement> result;
+    for (auto it = statements.begin(); it != statements.end(); ++it)
+    {
+        const codegen::If * if_st = boost::get<codegen::If>(&it->statement);
+        if (!if_st)
+        {
+            result.push_back(*it);
+            if (terminates(result))
+                break;
+            continue;
+        }
+
+        codegen::If nested(*if_st);
+        std::list<codegen::Statement> rest(std::next(it), statements.end());
+        bool then_ends = terminates(nested.thenBody), else_ends = terminates(nested.elseBody);
+        bool moves_rest = !rest.empty() && (then_ends || else_ends);
+        if (moves_rest && !then_ends)
+            nested.thenBody.insert(nested.thenBody.end(), rest.begin(), rest.end());
+        if (moves_rest && !else_ends)
+            nested.elseBody.insert(nested.elseBody.end(), rest.begin(), rest.end());
+        nested.thenBody = nest_returns(nested.thenBody);
+        nested.elseBody = nest_returns(nested.elseBody);
+        result.push_back(codegen::Statement(nested));
+        if (moves_rest)
+            break;
+    }
+    return result;
+}
+
+/* Whether every return ends the function, so it can become an assignment of the result */
+bool returns_at_end(const std::list<codegen::Statement> & statements, bool at_end)
+{
+    for (auto it = statements.begin(); it != statements.end(); ++it)
+    {
+        bool last = at_end && std::next(it) == statements.end();
+        if (boost::get<ast::Return>(&it->statement) && !last)
+            return false;
+
+        const codegen::If * if_st = boost::get<codegen::If>(&it->statement);
+        if (if_st && (!returns_at_end(if_st->thenBody, last) || !returns_at_end(if_st->elseBody, last)))
+            return false;
+
+        const codegen::While * while_st = boost::get<codegen::While>(&it->statement);
+        if (while_st && !returns_at_end(while_st->body, false))
+            return false;
+    }
+    return true;
+}
+
+std::list<codegen::Statement> assign_returns(const std::list<codegen::Statement> & statements,
+                                             const std::string & result)
+{
+    std::list<codegen::Statement> assigned;
+    for (const auto & st : statements)
+    {
+        const ast::Return * ret = boost::get<ast::Return>(&st.statement);
+        const codegen::If * if_st = boost::get<codegen::If>(&st.statement);
+        if (ret)
+            assigned.push_back(codegen::Statement(ast::Assignment{ret->loc, ast::Value(result), ret->expr}));
+        else if (if_st)
+        {
+            codegen::If st_assigned(*if_st);
+            st_assigned.thenBody = assign_returns(if_st->thenBody, result);
+            st_assigned.elseBody = assign_returns(if_st->elseBody, result);
+            assigned.push_back(codegen::Statement(st_assigned));
+        }
+        else
+            assigned.push_back(st);
+    }
+    return assigned;
+}
+
+/* Calls of every function by name, and its other uses as a value */
+struct Uses
+{
+    void count(const ast::Const &)
+    { }
+
+    void count(const std::string & name)
+    {
+        ++references[name];
+    }
+
+    void count(const ast::Value & expr)
+    {
+        fmap([this], x, this->count(x), expr.value);
+    }
+
+    void count(const ast::BinOperator & expr)
+    {
+        this->count(*expr.lhs);
+        this->count(*expr.rhs);
+    }
+
+    void count(const ast::Dereference & expr)
+    {
+        this->count(*expr.expr);
+    }
+
+    void count(const ast::Address & expr)
+    {
+        this->count(*expr.expr);
+    }
+
+    void count(const ast::Call & expr)
+    {
+        const std::string * name = called_name(expr);
+        if (name)
+            ++calls[*name];
+        else
+            this->count(*expr.function);
+        for (const auto & arg : expr.arguments)
+            this->count(arg);
+    }
+
+    void count(const ast::Read &)
+    { }
+
+    void count(const ast::Expression & expr)
+    {
+        fmap([this], x, this->count(x), expr.expression);
+    }
+
+    void count(const ast::Assignment & st)
+    {
+        this->count(st.lvalue);
+        this->count(st.rvalue);
+    }
+
+    void count(const codegen::If & st)
+    {
+        this->count(st.condition);
+        this->count(st.thenBody);
+        this->count(st.elseBody);
+    }
+
+    void count(const codegen::While & st)
+    {
+        this->count(st.condition);
+        this->count(st.body);
+    }
+
+    void count(const codegen::Continue &)
+    { }
+
+    void count(const ast::Write & st)
+    {
+        this->count(st.expr);
+    }
+
+    void count(const ast::Return & st)
+    {
+        this->count(st.expr);
+    }
+
+    void count(const std::list<codegen::Statement> & statements)
+    {
+        for (const auto & st : statements)
+            fmap([this], x, this->count(x), st.statement);
+    }
+
+    std::map<std::string, std::size_t> calls;
+    std::map<std::string, std::size_t> references;
+};
+
+/* Body of a function prepared to be inlined, with its returns at the end */
+struct Callee
+{
+    const codegen::Function * f;
+    std::list<codegen::Statement> statements;
+    std::size_t size;
+    bool single_call;
+};
+
+/*
+ * Inlines calls in the body of one function. The call is moved in front
+ * of its statement and its value is taken from a result variable, which
+ * the inlined body assigns instead of returning. Parameters, locals and
+ * labels of the callee get a prefix unique to the call site. A call is
+ * only moved if everything evaluated before it in the statement is left
+ * unaffected by the move.
+ */
+struct Inliner
+{
+    Inliner(codegen::Function & f, const std::map<std::string, Callee> & callees)
+        : f(f)
+        , callees(callees)
+        , sites(0)
+        , function_size(size(f.statements))
+    {
+        for (const auto & arg : f.arguments)
+            locals.insert(arg.name);
+        for (const auto & var : f.variables)
+            locals.insert(var.name);
+        collect_address_taken(f.statements);
+    }
+
+    void collect_address_taken(const ast::Expression & expr)
+    {
+        const ast::Address * addr = boost::get<ast::Address>(&expr.expression);
+        const ast::Value * value = addr ? boost::get<ast::Value>(&addr->expr->expression) : nullptr;
+        const std::string * name = value ? boost::get<std::string>(&value->value) : nullptr;
+        if (name)
+            address_taken.insert(*name);
+
+        const ast::BinOperator * op = boost::get<ast::BinOperator>(&expr.expression);
+        const ast::Dereference * deref = boost::get<ast::Dereference>(&expr.expression);
+        const ast::Call * call = boost::get<ast::Call>(&expr.expression);
+        if (op)
+        {
+            collect_address_taken(*op->lhs);
+            collect_address_taken(*op->rhs);
+        }
+        if (deref)
+            collect_address_taken(*deref->expr);
+        if (addr)
+            collect_address_taken(*addr->expr);
+        if (call)
+        {
+            collect_address_taken(*call->function);
+            for (const auto & arg : call->arguments)
+                collect_address_taken(arg);
+        }
+    }
+
+    void collect_address_taken(const std::list<codegen::Statement> & statements)
+    {
+        for (const auto & st : statements)
+        {
+            const ast::Assignment * assignment = boost::get<ast::Assignment>(&st.statement);
+            const codegen::If * if_st = boost::get<codegen::If>(&st.statement);
+            const codegen::While * while_st = boost::get<codegen::While>(&st.statement);
+            const ast::Write * write = boost::get<ast::Write>(&st.statement);
+            const ast::Return * ret = boost::get<ast::Return>(&st.statement);
+            if (assignment)
+            {
+                collect_address_taken(assignment->lvalue);
+                collect_address_taken(assignment->rvalue);
+            }
+            if (if_st)
+            {
+                collect_address_taken(if_st->condition);
+                collect_address_taken(if_st->thenBody);
+                collect_address_taken(if_st->elseBody);
+            }
+            if (while_st)
+            {
+                collect_address_taken(while_st->condition);
+                collect_address_taken(while_st->body);
+            }
+            if (write)
+                collect_address_taken(write->expr);
+            if (ret)
+                collect_address_taken(ret->expr);
+        }
+    }
+
+    /* Whether a name may be changed by a callee writing memory */
+    bool in_memory(const std::string & name) const
+    {
+        return !locals.count(name) || address_taken.count(name);
+    }
+
+    bool worth_inlining(const Callee & callee, const ast::Call & call) const
+    {
+        if (callee.f == &f || function_size + callee.size > max_function_size)
+            return false;
+
+        std::size_t budget = callee.single_call ? single_call_budget
+            : in_loop ? loop_inline_budget : inline_budget;
+        for (const auto & arg : call.arguments)
+        {
+            const ast::Value * value = boost::get<ast::Value>(&arg.expression);
+            if (value && boost::get<ast::Const>(&value->value))
+                budget += constant_argument_bonus;
+        }
+        return callee.size <= budget;
+    }
+
+    bool can_move(const Callee & callee) const
+    {
+        const codegen::Effects & effects = callee.f->effects;
+        return !unsafe_before && !(memory_before && (effects.writes_memory || effects.io));
+    }
+
+    /* Expressions evaluated before a call, which is not searched for calls to inline */
+    void evaluated(const ast::Expression & expr)
+    {
+        const ast::Value * value = boost::get<ast::Value>(&expr.expression);
+        const std::string * name = value ? boost::get<std::string>(&value->value) : nullptr;
+        const ast::BinOperator * op = boost::get<ast::BinOperator>(&expr.expression);
+        const ast::Dereference * deref = boost::get<ast::Dereference>(&expr.expression);
+        const ast::Address * addr = boost::get<ast::Address>(&expr.expression);
+        if (name && in_memory(*name))
+            memory_before = true;
+        if (op)
+        {
+            evaluated(*op->lhs);
+            evaluated(*op->rhs);
+            /* Division by zero traps, which must happen before the call */
+            unsafe_before |= op->oper.oper == ast::Oper::DIV || op->oper.oper == ast::Oper::MOD;
+        }
+        if (deref)
+        {
+            evaluated(*deref->expr);
+            memory_before = true;
+        }
+        if (addr)
+            evaluated(*addr->expr);
+        if (boost::get<ast::Call>(&expr.expression) || boost::get<ast::Read>(&expr.expression))
+            unsafe_before = true;
+    }
+
+    ast::Expression hoist(const ast::Value & expr)
+    {
+        evaluated(expr);
+        return expr;
+    }
+
+    ast::Expression hoist(const ast::BinOperator & expr)
+    {
+        ast::BinOperator result(expr);
+        result.lhs = std::make_shared<ast::Expression>(hoist(*expr.lhs));
+        /* The right hand side of && and || is not always evaluated */
+        if (expr.oper.oper == ast::Oper::AND || expr.oper.oper == ast::Oper::OR)
+            evaluated(*expr.rhs);
+        else
+            result.rhs = std::make_shared<ast::Expression>(hoist(*expr.rhs));
+        unsafe_before |= expr.oper.oper == ast::Oper::DIV || expr.oper.oper == ast::Oper::MOD;
+        return result;
+    }
+
+    ast::Expression hoist(const ast::Dereference & expr)
+    {
+        ast::Dereference result{expr.loc, std::make_shared<ast::Expression>(hoist(*expr.expr))};
+        memory_before = true;
+        return result;
+    }
+
+    ast::Expression hoist(const ast::Address & expr)
+    {
+        evaluated(*expr.expr);
+        return expr;
+    }
+
+    ast::Expression hoist(const ast::Call & expr)
+    {
+        ast::Call result(expr);
+        const std::string * name = called_name(expr);
+        auto callee = name ? callees.find(*name) : callees.end();
+        if (callee == callees.end())
+            result.function = std::make_shared<ast::Expression>(hoist(*expr.function));
+        result.arguments.clear();
+        for (const auto & arg : expr.arguments)
+            result.arguments.push_back(hoist(arg));
+
+        if (!call && callee != callees.end() && worth_inlining(callee->second, result) && can_move(callee->second))
+        {
+            call = result;
+            result_name = callee->second.f->name + "." + std::to_string(sites) + ".result";
+            return ast::Value(result_name);
+        }
+
+        unsafe_before = true;
+        return result;
+    }
+
+    ast::Expression hoist(const ast::Read & expr)
+    {
+        unsafe_before = true;
+        return expr;
+    }
+
+    /* Copy of `expr` with the first call to inline replaced by its result variable */
+    ast::Expression hoist(const ast::Expression & expr)
+    {
+        if (call)
+            return expr;
+        ast::Expression result = fmap([this], x, this->hoist(x), expr.expression);
+        result.loc = expr.loc;
+        return result;
+    }
+
+    void begin_search()
+    {
+        call = boost::none;
+        unsafe_before = false;
+        memory_before = false;
+    }
+
+    void inline_call(std::list<codegen::Statement> & statements)
+    {
+        const Callee & callee = callees.at(*called_name(*call));
+        Rename rename{callee.f->name + "." + std::to_string(sites++) + ".", {}};
+        for (const auto & arg : callee.f->arguments)
+            rename.locals.insert(arg.name);
+        for (const auto & var : callee.f->variables)
+            rename.locals.insert(var.name);
+
+        auto arg_it = call->arguments.begin();
+        for (const auto & parameter : callee.f->arguments)
+        {
+            codegen::Variable var = rename.rename(parameter);
+            f.variables.push_back(var);
+            statements.push_back(codegen::Statement(ast::Assignment{arg_it->loc, ast::Value(var.name), *arg_it}));
+            ++arg_it;
+        }
+        for (const auto & var : callee.f->variables)
+            f.variables.push_back(rename.rename(var));
+        f.variables.push_back({call->loc, callee.f->type, result_name});
+
+        std::list<codegen::Statement> body = assign_returns(rename.rename(callee.statements), result_name);
+        statements.insert(statements.end(), body.begin(), body.end());
+        function_size += callee.size;
+    }
+
+    /* Calls in the expression are inlined into `statements` one by one */
+    ast::Expression inline_calls(const ast::Expression & expr, std::list<codegen::Statement> & statements)
+    {
+        ast::Expression result = expr;
+        while (true)
+        {
+            begin_search();
+            result = hoist(result);
+            if (!call)
+                return result;
+            inline_call(statements);
+        }
+    }
+
+    void inline_statement(const ast::Assignment & st, std::list<codegen::Statement> & statements)
+    {
+        ast::Assignment result(st);
+        const ast::Dereference * deref = boost::get<ast::Dereference>(&st.lvalue.expression);
+        if (!deref)
+            result.rvalue = inline_calls(st.rvalue, statements);
+        else
+        {
+            /* The address is evaluated before the value */
+            ast::Expression rvalue = st.rvalue;
+            while (true)
+            {
+                begin_search();
+                evaluated(*deref->expr);
+                rvalue = hoist(rvalue);
+                if (!call)
+                    break;
+                inline_call(statements);
+            }
+            result.rvalue = rvalue;
+        }
+        statements.push_back(codegen::Statement(result));
+    }
+
+    void inline_statement(const codegen::If & st, std::list<codegen::Statement> & statements)
+    {
+        codegen::If result(st);
+        result.condition = inline_calls(st.condition, statements);
+        result.thenBody = inline_calls(st.thenBody);
+        result.elseBody = inline_calls(st.elseBody);
+        statements.push_back(codegen::Statement(result));
+    }
+
+    /* The condition is evaluated on every iteration, calls in it stay */
+    void inline_statement(const codegen::While & st, std::list<codegen::Statement> & statements)
+    {
+        codegen::While result(st);
+        bool outer_loop = in_loop;
+        in_loop = true;
+        result.body = inline_calls(st.body);
+        in_loop = outer_loop;
+        statements.push_back(codegen::Statement(result));
+    }
+
+    void inline_statement(const codegen::Continue & st, std::list<codegen::Statement> & statements)
+    {
+        statements.push_back(codegen::Statement(st));
+    }
+
+    void inline_statement(const ast::Write & st, std::list<codegen::Statement> & statements)
+    {
+        ast::Write result(st);
+        result.expr = inline_calls(st.expr, statements);
+        statements.push_back(codegen::Statement(result));
+    }
+
+    void inline_statement(const ast::Return & st, std::list<codegen::Statement> & statements)
+    {
+        ast::Return result(st);
+        result.expr = inline_calls(st.expr, statements);
+        statements.push_back(codegen::Statement(result));
+    }
+
+    std::list<codegen::Statement> inline_calls(const std::list<codegen::Statement> & statements)
+    {
+        std::list<codegen::Statement> result;
+        for (const auto & st : statements)
+            fmap([&], x, this->inline_statement(x, result), st.statement);
+        return result;
+    }
+
+    void optimise()
+    {
+        in_loop = false;
+        f.statements = inline_calls(f.statements);
+    }
+
+    codegen::Function & f;
+    const std::map<std::string, Callee> & callees;
+    std::set<std::string> locals;
+    std::set<std::string> address_taken;
+    std::size_t sites;
+    std::size_t function_size;
+
+    bool in_loop;
+    /* State of the search for a call to inline in one expression */
+    boost::optional<ast::Call> call;
+    std::string result_name;
+    bool unsafe_before;
+    bool memory_before;
+};
+
+void callees_first(codegen::Function * f, const std::map<std::string, codegen::Function *> & functions,
+                   std::set<std::string> & visited, std::list<codegen::Function *> & order)
+{
+    if (!visited.insert(f->name).second)
+        return;
+
+    Uses uses;
+    uses.count(f->statements);
+    for (const auto & called : uses.calls)
+    {
+        auto callee = functions.find(called.first);
+        if (callee != functions.end())
+            callees_first(callee->second, functions, visited, order);
+    }
+    order.push_back(f);
+}
+}
+
+void inline_functions(codegen::Code & code)
+{
+    analyse_effects(code);
+
+    std::map<std::string, codegen::Function *> functions;
+    std::list<codegen::Function *> entries;
+    Uses uses;
+    for (auto & entry : code.entries)
+    {
+        codegen::Function * f = boost::get<codegen::Function>(&entry.entry);
+        if (!f)
+            continue;
+        functions[f->name] = f;
+        entries.push_back(f);
+        uses.count(f->statements);
+    }
+
+    /* Callees are done first, so what is inlined into them is inlined along */
+    std::set<std::string> visited;
+    std::list<codegen::Function *> order;
+    for (codegen::Function * f : entries)
+        callees_first(f, functions, visited, order);
+
+    std::map<std::string, Callee> callees;
+    for (codegen::Function * f : order)
+    {
+        Inliner inliner(*f, callees);
+        inliner.optimise();
+
+        std::list<codegen::Statement> statements = nest_returns(f->statements);
+        if (f->effects.recursive || !returns_at_end(statements, true))
+            continue;
+        bool single_call = uses.calls[f->name] == 1 && !uses.references[f->name];
+        callees.emplace(f->name, Callee{f, statements, size(statements), single_call});
+    }
+}
+}
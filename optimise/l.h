@@ -8,6 +8,26 @@ void optimise_functions(
     std::function<std::list<codegen::Function>(codegen::Function &)> optimisation,
     codegen::Code & code);
 
+/*
+ * Inlines calls of small non-recursive functions, judged by size and by
+ * whether the call is in a loop. Analyses effects to decide where a call
+ * may be moved, they have to be analysed again after other rewrites.
+ */
+void inline_functions(codegen::Code & code);
 void optimise_to_accum(codegen::Code & code);
+/*
+ * Folds constant expressions and propagates constants assigned to local
+ * variables and never assigned globals, dropping branches and loops
+ * which cannot be taken.
+ */
+void propagate_constants(codegen::Code & code);
 void optimise_tail_call(codegen::Code & code);
+/* Fills in codegen::Function::effects, bottom-up over the call graph */
+void analyse_effects(codegen::Code & code);
+/*
+ * Marks pure recursive functions with int arguments to be memoised and
+ * returns their names. Needs effects, which have to be analysed again
+ * afterwards as memoised functions use memory for their tables.
+ */
+std::list<std::string> memoise_functions(codegen::Code & code);
 }
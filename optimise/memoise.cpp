@@ -0,0 +1,47 @@
+#include "l.h"
+
+namespace optimise
+{
+namespace
+{
+bool is_int(const ast::Type & type)
+{
+    const ast::AtomType * atom = boost::get<ast::AtomType>(&type.type);
+    return atom && atom->type == ast::AtomType::INT;
+}
+
+/*
+ * A pure function returns the same result for the same arguments, and
+ * int arguments can be compared and hashed as they are. Functions which
+ * do not recurse are left alone, they are not called with the same
+ * arguments over and over.
+ */
+bool is_memoisable(const codegen::Function & f)
+{
+    const codegen::Effects & effects = f.effects;
+    if (!effects.recursive || effects.reads_memory || effects.writes_memory || effects.io)
+        return false;
+    if (f.arguments.empty() || !boost::get<ast::AtomType>(&f.type.type))
+        return false;
+    for (const auto & arg : f.arguments)
+        if (!is_int(arg.type))
+            return false;
+    return true;
+}
+}
+
+std::list<std::string> memoise_functions(codegen::Code & code)
+{
+    std::list<std::string> result;
+    for (auto & entry : code.entries)
+    {
+        codegen::Function * f = boost::get<codegen::Function>(&entry.entry);
+        if (f && is_memoisable(*f))
+        {
+            f->memoise = true;
+            result.push_back(f->name);
+        }
+    }
+    return result;
+}
+}
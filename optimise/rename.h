@@ -0,0 +1,116 @@
+#pragma once
+
+#include <gen/ast/l.h>
+#include <utils/fmap.h>
+
+#include <memory>
+#include <set>
+#include <string>
+
+namespace optimise
+{
+/* Prefixes locals and labels of a function, so bodies of several functions can be put together */
+struct Rename
+{
+    std::string rename(const std::string & name) const
+    {
+        return locals.count(name) ? prefix + name : name;
+    }
+
+    ast::Const rename(const ast::Const & expr) const
+    {
+        return expr;
+    }
+
+    ast::Value rename(const ast::Value & expr) const
+    {
+        return fmap([this], x, ast::Value(this->rename(x)), expr.value);
+    }
+
+    std::shared_ptr<ast::Expression> rename(const std::shared_ptr<ast::Expression> & expr) const
+    {
+        return std::make_shared<ast::Expression>(rename(*expr));
+    }
+
+    ast::BinOperator rename(const ast::BinOperator & expr) const
+    {
+        return {expr.loc, rename(expr.lhs), rename(expr.rhs), expr.oper};
+    }
+
+    ast::Dereference rename(const ast::Dereference & expr) const
+    {
+        return {expr.loc, rename(expr.expr)};
+    }
+
+    ast::Address rename(const ast::Address & expr) const
+    {
+        return {expr.loc, rename(expr.expr)};
+    }
+
+    ast::Call rename(const ast::Call & expr) const
+    {
+        std::list<ast::Expression> arguments;
+        for (const auto & arg : expr.arguments)
+            arguments.push_back(rename(arg));
+        return {expr.loc, rename(expr.function), arguments};
+    }
+
+    ast::Read rename(const ast::Read & expr) const
+    {
+        return {expr.loc, rename(expr.varname)};
+    }
+
+    ast::Expression rename(const ast::Expression & expr) const
+    {
+        ast::Expression result = fmap([this], x, ast::Expression(this->rename(x)), expr.expression);
+        result.loc = expr.loc;
+        return result;
+    }
+
+    codegen::Statement rename(const ast::Assignment & st) const
+    {
+        return codegen::Statement(ast::Assignment{st.loc, rename(st.lvalue), rename(st.rvalue)});
+    }
+
+    codegen::Statement rename(const codegen::If & st) const
+    {
+        return codegen::Statement(codegen::If{st.loc, rename(st.condition), rename(st.thenBody), rename(st.elseBody)});
+    }
+
+    codegen::Statement rename(const codegen::While & st) const
+    {
+        return codegen::Statement(codegen::While{st.loc, prefix + st.label, rename(st.condition), rename(st.body)});
+    }
+
+    codegen::Statement rename(const codegen::Continue & st) const
+    {
+        return codegen::Statement(codegen::Continue{st.loc, prefix + st.label});
+    }
+
+    codegen::Statement rename(const ast::Write & st) const
+    {
+        return codegen::Statement(ast::Write{st.loc, rename(st.expr)});
+    }
+
+    codegen::Statement rename(const ast::Return & st) const
+    {
+        return codegen::Statement(ast::Return{st.loc, rename(st.expr)});
+    }
+
+    std::list<codegen::Statement> rename(const std::list<codegen::Statement> & statements) const
+    {
+        std::list<codegen::Statement> result;
+        for (const auto & st : statements)
+            result.push_back(fmap([this], x, this->rename(x), st.statement));
+        return result;
+    }
+
+    codegen::Variable rename(const codegen::Variable & var) const
+    {
+        return {var.loc, var.type, rename(var.name)};
+    }
+
+    std::string prefix;
+    std::set<std::string> locals;
+};
+}
@@ -1,9 +1,14 @@
 #include "l.h"
 #include "recursive.h"
+#include "rename.h"
 
 #include <utils/undefined.h>
 #include <utils/fmap.h>
 
+#include <map>
+#include <set>
+#include <vector>
+
 namespace optimise
 {
 namespace
@@ -164,10 +169,293 @@ void optimise_tail_call(codegen::Function & func)
     TCO tco(func);
     func = tco.optimise();
 }
+
+/* Name of the function called by `return f(...)`, unless it is called through a pointer */
+const std::string * tail_callee(const ast::Return & ret)
+{
+    const ast::Call * call = boost::get<ast::Call>(&ret.expr.expression);
+    if (!call)
+        return nullptr;
+
+    const ast::Value * value = boost::get<ast::Value>(&call->function->expression);
+    return value ? boost::get<std::string>(&value->value) : nullptr;
+}
+
+void get_tail_callees(const std::list<codegen::Statement> & statements, std::set<std::string> & callees)
+{
+    for (const auto & st : statements)
+    {
+        const ast::Return * ret = boost::get<ast::Return>(&st.statement);
+        if (ret && tail_callee(*ret))
+            callees.insert(*tail_callee(*ret));
+
+        const codegen::If * if_st = boost::get<codegen::If>(&st.statement);
+        if (if_st)
+        {
+            get_tail_callees(if_st->thenBody, callees);
+            get_tail_callees(if_st->elseBody, callees);
+        }
+
+        const codegen::While * while_st = boost::get<codegen::While>(&st.statement);
+        if (while_st)
+            get_tail_callees(while_st->body, callees);
+    }
+}
+
+/*
+ * Functions calling each other in tail position are put together into
+ * one function, whose first argument says which of them runs. A tail
+ * call within the group assigns the arguments of the callee and
+ * continues the dispatch loop, so it takes no stack. The functions
+ * themselves are left calling the merged one.
+ */
+struct Mutual
+{
+    struct Member
+    {
+        codegen::Function * f;
+        Rename rename;
+        std::list<codegen::Variable> parameters;
+        std::list<codegen::Variable> saved_arguments;
+    };
+
+    Mutual(const std::vector<codegen::Function *> & group, const std::string & name)
+        : name(name)
+        , label(name + "_dispatch")
+        , function_variable(name + ".function")
+    {
+        for (codegen::Function * f : group)
+        {
+            Member member{f, {f->name + ".", {}}, {}, {}};
+            for (const auto & arg : f->arguments)
+                member.rename.locals.insert(arg.name);
+            for (const auto & var : f->variables)
+                member.rename.locals.insert(var.name);
+            for (const auto & arg : f->arguments)
+                member.parameters.push_back(member.rename.rename(arg));
+            size_t i = 0;
+            for (const auto & arg : f->arguments)
+                member.saved_arguments.push_back({arg.loc, arg.type, f->name + ".saved_arg_" + std::to_string(i++)});
+
+            index[f->name] = members.size();
+            members.push_back(member);
+        }
+    }
+
+    ast::Expression function_number(size_t i) const
+    {
+        return ast::Value(ast::Const(static_cast<std::int64_t>(i)));
+    }
+
+    void jump(const ast::Return & ret, const std::string & callee, std::list<codegen::Statement> & statements) const
+    {
+        const ast::Call & call = boost::get<ast::Call>(ret.expr.expression);
+        const Member & target = members[index.at(callee)];
+
+        /* Arguments may refer to parameters, all are evaluated before any parameter changes */
+        auto saved_arg_it = target.saved_arguments.begin();
+        for (const ast::Expression & arg : call.arguments)
+        {
+            ast::Assignment statement{arg.loc, ast::Value(saved_arg_it->name), arg};
+            statements.push_back(codegen::Statement(statement));
+            ++saved_arg_it;
+        }
+        assert(saved_arg_it == target.saved_arguments.end());
+
+        saved_arg_it = target.saved_arguments.begin();
+        for (const auto & parameter : target.parameters)
+        {
+            ast::Assignment statement{call.loc, ast::Value(parameter.name), ast::Value(saved_arg_it->name)};
+            statements.push_back(codegen::Statement(statement));
+            ++saved_arg_it;
+        }
+
+        ast::Assignment dispatch{call.loc, ast::Value(function_variable), function_number(index.at(callee))};
+        statements.push_back(codegen::Statement(dispatch));
+        statements.push_back(codegen::Statement(codegen::Continue{call.loc, label}));
+    }
+
+    void rewrite_tail_calls(std::list<codegen::Statement> & statements) const
+    {
+        std::list<codegen::Statement> result;
+        for (auto & st : statements)
+        {
+            codegen::If * if_st = boost::get<codegen::If>(&st.statement);
+            if (if_st)
+            {
+                rewrite_tail_calls(if_st->thenBody);
+                rewrite_tail_calls(if_st->elseBody);
+            }
+
+            codegen::While * while_st = boost::get<codegen::While>(&st.statement);
+            if (while_st)
+                rewrite_tail_calls(while_st->body);
+
+            const ast::Return * ret = boost::get<ast::Return>(&st.statement);
+            const std::string * callee = ret ? tail_callee(*ret) : nullptr;
+            if (callee && index.count(*callee))
+                jump(*ret, *callee, result);
+            else
+                result.push_back(st);
+        }
+        statements = result;
+    }
+
+    std::list<codegen::Statement> body(const Member & member) const
+    {
+        std::list<codegen::Statement> result = member.rename.rename(member.f->statements);
+        rewrite_tail_calls(result);
+        return result;
+    }
+
+    codegen::Function merged() const
+    {
+        const codegen::Function & first = *members.front().f;
+        codegen::Function result(first);
+        result.name = name;
+        result.effects = codegen::Effects();
+        result.memoise = false;
+        result.arguments = {{first.loc, ast::int_type(), function_variable}};
+        result.variables.clear();
+        for (const auto & member : members)
+        {
+            result.arguments.insert(result.arguments.end(), member.parameters.begin(), member.parameters.end());
+            for (const auto & var : member.f->variables)
+                result.variables.push_back(member.rename.rename(var));
+            result.variables.insert(result.variables.end(),
+                                    member.saved_arguments.begin(), member.saved_arguments.end());
+        }
+
+        /* if (function == 0) ... else if (function == 1) ... else <last> */
+        std::list<codegen::Statement> dispatch = body(members.back());
+        for (size_t i = members.size() - 1; i-- > 0; )
+        {
+            ast::BinOperator condition{first.loc,
+                                       std::make_shared<ast::Expression>(ast::Value(function_variable)),
+                                       std::make_shared<ast::Expression>(function_number(i)),
+                                       ast::Oper{first.loc, ast::Oper::EQ}};
+            codegen::If st{first.loc, condition, body(members[i]), dispatch};
+            dispatch = {codegen::Statement(st)};
+        }
+
+        codegen::While loop{first.loc, label, ast::Const(true), dispatch};
+        result.statements = {codegen::Statement(loop)};
+        return result;
+    }
+
+    /* The parameters of the other functions are left uninitialised */
+    void make_wrapper(const Member & member) const
+    {
+        codegen::Function & f = *member.f;
+        std::list<ast::Expression> arguments = {function_number(index.at(f.name))};
+        f.variables.clear();
+        for (const auto & other : members)
+        {
+            if (other.f == member.f)
+            {
+                for (const auto & arg : f.arguments)
+                    arguments.push_back(ast::Value(arg.name));
+                continue;
+            }
+            for (const auto & parameter : other.parameters)
+            {
+                f.variables.push_back(parameter);
+                arguments.push_back(ast::Value(parameter.name));
+            }
+        }
+
+        ast::Call call{f.loc, std::make_shared<ast::Expression>(ast::Value(name)), arguments};
+        f.statements = {codegen::Statement(ast::Return{f.loc, call})};
+    }
+
+    std::string name;
+    std::string label;
+    std::string function_variable;
+    std::vector<Member> members;
+    std::map<std::string, size_t> index;
+};
+
+bool reaches(const std::map<std::string, std::set<std::string>> & calls,
+             const std::string & from, const std::string & to)
+{
+    std::set<std::string> visited = {from};
+    std::list<std::string> pending = {from};
+    while (!pending.empty())
+    {
+        std::string name = pending.front();
+        pending.pop_front();
+        for (const auto & callee : calls.at(name))
+        {
+            if (callee == to)
+                return true;
+            if (visited.insert(callee).second)
+                pending.push_back(callee);
+        }
+    }
+    return false;
+}
+
+/* Merges every group of two or more functions reaching each other by tail calls */
+void optimise_mutual_tail_calls(codegen::Code & code)
+{
+    std::set<std::string> names;
+    std::vector<codegen::Function *> functions;
+    for (auto & entry : code.entries)
+    {
+        codegen::Function * f = boost::get<codegen::Function>(&entry.entry);
+        if (f)
+            functions.push_back(f);
+        names.insert(f ? f->name : boost::get<codegen::Variable>(entry.entry).name);
+    }
+
+    std::map<std::string, std::set<std::string>> tail_calls;
+    for (codegen::Function * f : functions)
+    {
+        std::set<std::string> callees;
+        get_tail_callees(f->statements, callees);
+        for (codegen::Function * g : functions)
+            if (callees.count(g->name))
+                tail_calls[f->name].insert(g->name);
+        tail_calls[f->name];
+    }
+
+    std::set<std::string> grouped;
+    std::list<codegen::Function> merged;
+    for (codegen::Function * f : functions)
+    {
+        if (grouped.count(f->name))
+            continue;
+
+        std::vector<codegen::Function *> group;
+        for (codegen::Function * g : functions)
+            if (g == f || (reaches(tail_calls, f->name, g->name) && reaches(tail_calls, g->name, f->name)))
+                group.push_back(g);
+        for (codegen::Function * g : group)
+            grouped.insert(g->name);
+
+        /* All of them return what the merged function returns */
+        bool same_type = true;
+        for (codegen::Function * g : group)
+            same_type = same_type && g->type == f->type;
+
+        std::string name = f->name + "_mutual";
+        if (group.size() < 2 || !same_type || names.count(name))
+            continue;
+
+        Mutual mutual(group, name);
+        merged.push_back(mutual.merged());
+        for (const auto & member : mutual.members)
+            mutual.make_wrapper(member);
+    }
+
+    for (const auto & f : merged)
+        code.entries.push_back(codegen::CodeEntry(f));
+}
 }
 
 void optimise_tail_call(codegen::Code & code)
 {
+    optimise_mutual_tail_calls(code);
     optimise_functions([] (codegen::Function & f)
     {
         optimise_tail_call(f);
@@ -2,18 +2,26 @@
 
 #include "lexer.h"
 
+#include <stdexcept>
+
 namespace ast
 {
-Code parser::parse(std::istream & in, std::ostream & out)
+Code parser::parse(std::istream & in)
 {
-    lexer_t lexer(in, out);
+    diagnostics.str("");
+    lexer_t lexer(in, diagnostics);
     this->lexer = &lexer;
 
     generated_parser p(*this);
 
     code.entries.clear();
     if (p.parse())
-        throw std::runtime_error("Parser failed");
+    {
+        std::string message = diagnostics.str();
+        while (!message.empty() && message.back() == '\n')
+            message.pop_back();
+        throw std::runtime_error(message.empty() ? "Parser failed" : message);
+    }
 
     return code;
 }
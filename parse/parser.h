@@ -3,6 +3,7 @@
 #include "ast/l.h"
 
 #include <iostream>
+#include <sstream>
 
 struct lexer_t;
 
@@ -11,10 +12,13 @@ namespace ast
 
 struct parser
 {
-    Code parse(std::istream & in, std::ostream & out);
+    /* Throws std::runtime_error with the diagnostics if the input does not parse */
+    Code parse(std::istream & in);
 
     Code code;
     lexer_t * lexer;
+    /* Syntax errors and characters the lexer did not match */
+    std::ostringstream diagnostics;
 };
 
 }
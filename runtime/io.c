@@ -0,0 +1,154 @@
+#include "lcrt.h"
+#include "io.h"
+#include "syscall.h"
+
+#define LC_EINTR 4
+
+static char input_data[1 << 16];
+static char output_data[1 << 16];
+static int input_eof;
+static int input_mapped;
+
+struct lc_buffer lc_input = {input_data, input_data};
+struct lc_buffer lc_output = {output_data, output_data + sizeof(output_data)};
+
+/*
+ * If stdin is a regular file, maps the rest of it, so integers are
+ * parsed straight from the page cache without copying. Pipes and
+ * terminals, or files which can't be mapped, are read into the buffer.
+ */
+static void map_input(void)
+{
+    struct lc_stat st;
+    if (lc_syscall3(LC_SYS_FSTAT, 0, (long) &st, 0) != 0
+        || (st.mode & LC_S_IFMT) != LC_S_IFREG)
+        return;
+
+    long offset = lc_syscall3(LC_SYS_LSEEK, 0, 0, LC_SEEK_CUR);
+    if (offset < 0 || offset >= st.size)
+        return;
+
+    long address = lc_syscall6(LC_SYS_MMAP, 0, st.size, LC_PROT_READ, LC_MAP_PRIVATE, 0, 0);
+    if (address < 0 && address > -4096)
+        return;
+    lc_syscall3(LC_SYS_MADVISE, address, st.size, LC_MADV_SEQUENTIAL);
+
+    input_mapped = 1;
+    lc_input.pos = (char *) address + offset;
+    lc_input.end = (char *) address + st.size;
+}
+
+/* Moves unread input to the start of the buffer and reads more after it, returns 0 at the end of input */
+static int refill(void)
+{
+    static int input_checked;
+    if (!input_checked)
+    {
+        input_checked = 1;
+        map_input();
+        if (input_mapped)
+            return lc_input.pos != lc_input.end;
+    }
+
+    /* The mapping covers the whole file */
+    if (input_eof || input_mapped)
+        return 0;
+
+    char * unread = lc_input.pos;
+    char * end = input_data;
+    while (unread != lc_input.end)
+        *end++ = *unread++;
+    lc_input.pos = input_data;
+    lc_input.end = end;
+
+    /* The other side of a pipe or terminal may wait for our output before writing more input */
+    lc_flush();
+
+    long r;
+    do
+        r = lc_syscall3(LC_SYS_READ, 0, (long) end, input_data + sizeof(input_data) - end);
+    while (r == -LC_EINTR);
+    if (r <= 0)
+    {
+        input_eof = 1;
+        return 0;
+    }
+    lc_input.end += r;
+    return 1;
+}
+
+/* Returns the next input character without consuming it, -1 at the end of input */
+static int peek_char(void)
+{
+    if (lc_input.pos == lc_input.end && !refill())
+        return -1;
+    return (unsigned char) *lc_input.pos;
+}
+
+static int is_space(int c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static int is_digit(int c)
+{
+    return c >= '0' && c <= '9';
+}
+
+int32_t lc_read_int_slow(int64_t * value)
+{
+    int c;
+    while (is_space(c = peek_char()))
+        ++lc_input.pos;
+
+    int negative = c == '-';
+    if (c == '-' || c == '+')
+    {
+        ++lc_input.pos;
+        c = peek_char();
+    }
+
+    /* Anything but a number ends the input, scanf would get stuck on it */
+    if (!is_digit(c))
+        return 0;
+
+    uint64_t result = 0;
+    do
+    {
+        result = result * 10 + (c - '0');
+        ++lc_input.pos;
+    }
+    while (is_digit(c = peek_char()));
+
+    *value = negative ? -(int64_t) result : (int64_t) result;
+    return 1;
+}
+
+int32_t lc_read_int_binary_slow(int64_t * value)
+{
+    while (lc_input.end - lc_input.pos < 8)
+    {
+        /* A truncated last word is dropped */
+        if (!refill())
+            return 0;
+    }
+
+    __builtin_memcpy(value, lc_input.pos, 8);
+    lc_input.pos += 8;
+    return 1;
+}
+
+void lc_flush(void)
+{
+    char * data = output_data;
+    while (data != lc_output.pos)
+    {
+        long r = lc_syscall3(LC_SYS_WRITE, 1, (long) data, lc_output.pos - data);
+        if (r == -LC_EINTR)
+            continue;
+        if (r < 0)
+            break;
+        data += r;
+    }
+    lc_output.pos = output_data;
+}
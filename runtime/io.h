@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * State shared by the I/O fast path (io_fast.c), which may be inlined
+ * into generated code, and the slow path (io.c), which always lives in
+ * the native runtime.
+ */
+
+/* Unread input, or free output space, is the range [pos, end) */
+struct lc_buffer
+{
+    char * pos;
+    char * end;
+};
+
+extern struct lc_buffer lc_input;
+extern struct lc_buffer lc_output;
+
+/* Reads an integer which may cross the end of the buffered input */
+int32_t lc_read_int_slow(int64_t * value);
+int32_t lc_read_int_binary_slow(int64_t * value);
+
+#ifdef __cplusplus
+}
+#endif
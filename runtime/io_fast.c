@@ -0,0 +1,137 @@
+#include "lcrt.h"
+#include "io.h"
+
+/*
+ * Fast path of integer I/O working on the buffers only. lcc links it
+ * as bitcode into the generated module, so it can be inlined into the
+ * loops calling read and write.
+ */
+
+static int is_space(int c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static int is_digit(int c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/* Eight ASCII digits loaded as a little endian word, see Lemire, "Fast number parsing" */
+static int is_eight_digits(uint64_t chunk)
+{
+    return ((chunk & 0xf0f0f0f0f0f0f0f0) | (((chunk + 0x0606060606060606) & 0xf0f0f0f0f0f0f0f0) >> 4))
+        == 0x3333333333333333;
+}
+
+static uint64_t parse_eight_digits(uint64_t chunk)
+{
+    const uint64_t mask = 0x000000ff000000ff;
+    const uint64_t mul1 = 100 + (1000000ull << 32);
+    const uint64_t mul2 = 1 + (10000ull << 32);
+    chunk -= 0x3030303030303030;
+    chunk = chunk * 10 + (chunk >> 8);
+    return (((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32;
+}
+
+int32_t lc_read_int(int64_t * value)
+{
+    char * p = lc_input.pos;
+    char * end = lc_input.end;
+
+    while (p != end && is_space(*p))
+        ++p;
+    lc_input.pos = p;
+
+    int negative = p != end && *p == '-';
+    if (p != end && (*p == '-' || *p == '+'))
+        ++p;
+
+    char * digits = p;
+    uint64_t result = 0;
+    while (end - p >= 8)
+    {
+        uint64_t chunk;
+        __builtin_memcpy(&chunk, p, 8);
+        if (!is_eight_digits(chunk))
+            break;
+        result = result * 100000000 + parse_eight_digits(chunk);
+        p += 8;
+    }
+    while (p != end && is_digit(*p))
+        result = result * 10 + (*p++ - '0');
+
+    /* The number may continue after the end of the buffer, or the input may end here */
+    if (p == end || p == digits)
+        return lc_read_int_slow(value);
+
+    lc_input.pos = p;
+    *value = negative ? -(int64_t) result : (int64_t) result;
+    return 1;
+}
+
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+void lc_write_int(int64_t value)
+{
+    /* Sign, 19 digits and a newline */
+    if (lc_output.end - lc_output.pos < 21)
+        lc_flush();
+
+    char * p = lc_output.pos;
+    uint64_t magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+    if (value < 0)
+        *p++ = '-';
+
+    unsigned length = 1;
+    for (uint64_t bound = 10; length < 19 && magnitude >= bound; bound *= 10)
+        ++length;
+
+    char * q = p + length;
+    lc_output.pos = q + 1;
+    *q = '\n';
+    while (magnitude >= 100)
+    {
+        unsigned pair = magnitude % 100 * 2;
+        magnitude /= 100;
+        *--q = digit_pairs[pair + 1];
+        *--q = digit_pairs[pair];
+    }
+    if (magnitude >= 10)
+    {
+        *--q = digit_pairs[magnitude * 2 + 1];
+        *--q = digit_pairs[magnitude * 2];
+    }
+    else
+        *--q = '0' + magnitude;
+}
+
+/* x86_64 is little endian, so words are copied as they are */
+int32_t lc_read_int_binary(int64_t * value)
+{
+    if (lc_input.end - lc_input.pos < 8)
+        return lc_read_int_binary_slow(value);
+
+    __builtin_memcpy(value, lc_input.pos, 8);
+    lc_input.pos += 8;
+    return 1;
+}
+
+void lc_write_int_binary(int64_t value)
+{
+    if (lc_output.end - lc_output.pos < 8)
+        lc_flush();
+
+    __builtin_memcpy(lc_output.pos, &value, 8);
+    lc_output.pos += 8;
+}
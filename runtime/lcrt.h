@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Entry points of the lc runtime called by code generated by lcc.
+ * The runtime does not depend on libc, it talks to the kernel directly.
+ */
+
+/* Reads the next integer from stdin, returns 0 at the end of input */
+int32_t lc_read_int(int64_t * value);
+/* Writes an integer followed by a newline to stdout, output is buffered */
+void lc_write_int(int64_t value);
+/* Same as above, but integers are raw 8 byte little endian words */
+int32_t lc_read_int_binary(int64_t * value);
+void lc_write_int_binary(int64_t value);
+/* Writes buffered output, called at exit */
+void lc_flush(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,29 @@
+#include "lcrt.h"
+#include "syscall.h"
+
+/* lc main returns a 64 bit int, which C does not allow to declare as main */
+int64_t lc_main(void) __asm__("main");
+
+void lc_start(void) __attribute__((noreturn));
+
+/*
+ * Process entry point of lc executables: clear the frame pointer
+ * for debuggers, align the stack as the ABI requires and call main.
+ */
+__asm__(
+    ".text\n"
+    ".globl _start\n"
+    ".type _start, @function\n"
+    "_start:\n"
+    "    xor %rbp, %rbp\n"
+    "    and $-16, %rsp\n"
+    "    call lc_start\n"
+    "    hlt\n");
+
+void lc_start(void)
+{
+    int64_t status = lc_main();
+    lc_flush();
+    for (;;)
+        lc_syscall1(LC_SYS_EXIT_GROUP, status);
+}
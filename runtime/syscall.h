@@ -0,0 +1,63 @@
+#pragma once
+
+/* Linux x86_64 system calls used by the runtime */
+
+#include <stdint.h>
+
+#define LC_SYS_READ 0
+#define LC_SYS_WRITE 1
+#define LC_SYS_FSTAT 5
+#define LC_SYS_LSEEK 8
+#define LC_SYS_MMAP 9
+#define LC_SYS_MADVISE 28
+#define LC_SYS_EXIT_GROUP 231
+
+#define LC_S_IFMT 0170000
+#define LC_S_IFREG 0100000
+#define LC_SEEK_CUR 1
+#define LC_PROT_READ 1
+#define LC_MAP_PRIVATE 2
+#define LC_MADV_SEQUENTIAL 2
+
+/* struct stat of the kernel */
+struct lc_stat
+{
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t nlink;
+    uint32_t mode;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t pad;
+    uint64_t rdev;
+    int64_t size;
+    int64_t blksize;
+    int64_t blocks;
+    uint64_t times[6];
+    int64_t reserved[3];
+};
+
+static inline long lc_syscall1(long n, long a)
+{
+    long ret;
+    __asm__ volatile ("syscall" : "=a"(ret) : "a"(n), "D"(a) : "rcx", "r11", "memory");
+    return ret;
+}
+
+static inline long lc_syscall3(long n, long a, long b, long c)
+{
+    long ret;
+    __asm__ volatile ("syscall" : "=a"(ret) : "a"(n), "D"(a), "S"(b), "d"(c) : "rcx", "r11", "memory");
+    return ret;
+}
+
+static inline long lc_syscall6(long n, long a, long b, long c, long d, long e, long f)
+{
+    long ret;
+    register long r10 __asm__("r10") = d;
+    register long r8 __asm__("r8") = e;
+    register long r9 __asm__("r9") = f;
+    __asm__ volatile ("syscall" : "=a"(ret) : "a"(n), "D"(a), "S"(b), "d"(c), "r"(r10), "r"(r8), "r"(r9)
+                      : "rcx", "r11", "memory");
+    return ret;
+}
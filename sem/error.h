@@ -15,17 +15,27 @@ struct semantic_error : std::runtime_error
                    const std::string & what_arg)
         : std::runtime_error(what_arg)
         , loc(loc)
+        , message(format_message(loc, what_arg))
     {}
 
     const char * what() const noexcept
+    {
+        return message.c_str();
+    }
+
+    std::shared_ptr<ast::location> loc;
+
+private:
+    static std::string format_message(const std::shared_ptr<ast::location> & loc,
+                                      const std::string & what_arg)
     {
         std::stringstream ss;
         if (loc)
             ss << *loc << ": ";
-        ss << std::runtime_error::what();
-        return ss.str().c_str();
+        ss << what_arg;
+        return ss.str();
     }
 
-    std::shared_ptr<ast::location> loc;
+    std::string message;
 };
 }
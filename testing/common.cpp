@@ -2,7 +2,16 @@
 
 #include <lcc/lcc.h>
 
-#include <queue>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
 #include <unistd.h>
 #include <stdexcept>
 #include <string.h>
@@ -14,16 +23,25 @@
 struct p2open
 {
     p2open(const char * command, int expected_exit_code = 0)
+        : p2open([command] { return execl(command, command, nullptr); }, expected_exit_code)
+    {}
+
+    // Runs child_main in a child process, its result is the exit code
+    p2open(const std::function<int()> & child_main, int expected_exit_code = 0)
     : expected_exit_code(expected_exit_code)
+    , exited(false)
     {
         // TODO: error handling
         int process_input[2];
         pipe(process_input);
         int process_output[2];
         pipe(process_output);
+        // A program exiting before reading all input must not kill the test
+        signal(SIGPIPE, SIG_IGN);
         child = fork();
         if (child == 0)
         {
+            signal(SIGPIPE, SIG_DFL);
             dup2(process_input[0], STDIN_FILENO);
             close(process_input[0]);
             close(process_input[1]);
@@ -31,7 +49,7 @@ struct p2open
             close(process_output[0]);
             close(process_output[1]);
 
-            execl(command, command, nullptr);
+            _exit(child_main());
         }
         close(process_input[0]);
         close(process_output[1]);
@@ -42,46 +60,71 @@ struct p2open
 
     void write(int i)
     {
-        write_buffer.push(i);
+        input += std::to_string(i) + "\n";
     }
 
-    void full_write(int fd, char * buf, size_t count)
+    void write_raw(const std::string & data)
     {
-        while (count > 0)
-        {
-            ssize_t r = ::write(fd, buf, count);
-            if (r == -1)
-                throw std::runtime_error(strerror(errno));
-
-            count -= r;
-            buf += r;
-        }
+        input += data;
     }
 
-    std::vector<int> read()
+    // Input is written while output is read, the program may block on either
+    std::string read_raw()
     {
+        std::string output;
+        std::size_t written = 0;
+        bool input_open = true;
         const size_t size = 4096;
         char buffer[size];
-        while (!write_buffer.empty())
+        while (true)
         {
-            int r = snprintf(buffer, size, "%d\n", write_buffer.front());
-            full_write(inputfd, buffer, r);
-            write_buffer.pop();
-        }
-        close(inputfd);
+            if (input_open && written == input.size())
+            {
+                close(inputfd);
+                input_open = false;
+            }
 
-        std::stringstream output;
-        int r;
-        do
-        {
-            r = ::read(outputfd, buffer, size);
-            if (r == -1)
+            pollfd fds[2] = {{outputfd, POLLIN, 0}, {inputfd, POLLOUT, 0}};
+            if (poll(fds, input_open ? 2 : 1, -1) == -1)
+            {
+                if (errno == EINTR)
+                    continue;
                 throw std::runtime_error(strerror(errno));
+            }
 
-            output << std::string(buffer, r);
+            if (input_open && fds[1].revents)
+            {
+                // Up to PIPE_BUF bytes are written without blocking
+                ssize_t r = ::write(inputfd, input.data() + written, std::min<size_t>(input.size() - written, PIPE_BUF));
+                if (r > 0)
+                    written += r;
+                else if (errno != EINTR)
+                    written = input.size();   // program exited without reading everything
+            }
+
+            if (fds[0].revents)
+            {
+                ssize_t r = ::read(outputfd, buffer, size);
+                if (r == -1)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    throw std::runtime_error(strerror(errno));
+                }
+                if (r == 0)
+                    break;
+                output.append(buffer, r);
+            }
         }
-        while (r != 0);
 
+        if (input_open)
+            close(inputfd);
+        return output;
+    }
+
+    std::vector<int> read()
+    {
+        std::stringstream output(read_raw());
         std::vector<int> result;
         while (true)
         {
@@ -115,16 +158,16 @@ struct p2open
     int expected_exit_code;
     pid_t child;
     int inputfd, outputfd;
-    std::queue<int> write_buffer;
+    std::string input;
     bool exited;
 };
 
 std::vector<int> test_compiled(const std::string & code, const std::vector<int> & input,
-                               lcc::Optimisations opt, const char * log_message, int expected_retcode)
+                               const lcc::Options & options, const char * log_message, int expected_retcode)
 {
     std::stringstream in(code);
     std::string compiled = lcc::create_temp_file("test_compiled_XXXXXX");
-    lcc::compile_executable(in, compiled, opt);
+    lcc::compile_executable(in, "test_compiled", compiled, options);
 
     auto start = std::chrono::system_clock::now();
     p2open proc(compiled.c_str(), expected_retcode);
@@ -140,6 +183,72 @@ std::vector<int> test_compiled(const std::string & code, const std::vector<int>
     return r;
 }
 
+std::vector<int> test_compiled_file_input(const std::string & code, const std::vector<int> & input,
+                                          const lcc::Options & options)
+{
+    std::stringstream in(code);
+    std::string compiled = lcc::create_temp_file("test_compiled_XXXXXX");
+    lcc::compile_executable(in, "test_compiled", compiled, options);
+
+    std::string input_file = lcc::create_temp_file("test_input_XXXXXX");
+    {
+        std::ofstream out(input_file);
+        for (auto i : input)
+            out << i << "\n";
+    }
+
+    p2open proc([&compiled, &input_file]
+    {
+        int fd = open(input_file.c_str(), O_RDONLY);
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+        return execl(compiled.c_str(), compiled.c_str(), nullptr);
+    });
+    auto r = proc.read();
+    proc.exit();
+    std::remove(input_file.c_str());
+    return r;
+}
+
+std::vector<std::int64_t> test_compiled_binary(const std::string & code, const std::string & input,
+                                               const lcc::Options & options)
+{
+    lcc::Options binary_options(options);
+    binary_options.binary_io = true;
+    std::stringstream in(code);
+    std::string compiled = lcc::create_temp_file("test_compiled_XXXXXX");
+    lcc::compile_executable(in, "test_compiled", compiled, binary_options);
+
+    p2open proc(compiled.c_str());
+    proc.write_raw(input);
+    std::string output = proc.read_raw();
+    proc.exit();
+
+    std::vector<std::int64_t> result(output.size() / sizeof(std::int64_t));
+    std::memcpy(result.data(), output.data(), result.size() * sizeof(std::int64_t));
+    return result;
+}
+
+std::string binary_input(const std::vector<std::int64_t> & input)
+{
+    return std::string(reinterpret_cast<const char *>(input.data()), input.size() * sizeof(std::int64_t));
+}
+
+std::vector<int> test_run(const std::string & code, const std::vector<int> & input,
+                          const lcc::Options & options)
+{
+    p2open proc([&code, &options]
+    {
+        std::stringstream in(code);
+        return lcc::run(in, "test_run", options);
+    });
+    for (auto i : input)
+        proc.write(i);
+    auto r = proc.read();
+    proc.exit();
+    return r;
+}
+
 std::vector<int> random_input(size_t size, int limit)
 {
     static std::mt19937 generator;
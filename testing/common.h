@@ -1,13 +1,27 @@
 #include <lcc/lcc.h>
 
+#include <cstdint>
 #include <vector>
 #include <string>
 
 std::vector<int> test_compiled(const std::string & code, const std::vector<int> & input,
-                               lcc::Optimisations opt = lcc::Optimisations::ACC,
+                               const lcc::Options & options = lcc::Options(),
                                const char * log_message = nullptr,
                                int expected_retcode = 0);
 
+// Stdin of the program is a regular file instead of a pipe
+std::vector<int> test_compiled_file_input(const std::string & code, const std::vector<int> & input,
+                                          const lcc::Options & options = lcc::Options());
+
+// Compiles with --binary-io, input and output are raw 8 byte integers
+std::vector<std::int64_t> test_compiled_binary(const std::string & code, const std::string & input,
+                                               const lcc::Options & options = lcc::Options());
+std::string binary_input(const std::vector<std::int64_t> & input);
+
+// Runs the code by the JIT in a child process
+std::vector<int> test_run(const std::string & code, const std::vector<int> & input,
+                          const lcc::Options & options = lcc::Options());
+
 std::vector<int> random_input(size_t size, int limit = std::numeric_limits<int>::max());
 
 #define EXPECT_EQ_RESULTS(size, limit, f, g) { auto in = random_input(size, limit); EXPECT_EQ(f(in), g(in)); }
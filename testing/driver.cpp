@@ -0,0 +1,260 @@
+#include "common.h"
+
+#include <lcc/cache.h>
+#include <lcc/lcc.h>
+#include <lcc/server.h>
+#include <utils/string.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <dirent.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utime.h>
+
+std::string temp_directory(const char * pattern)
+{
+    std::string directory = lcc::create_temp_file(pattern);
+    std::remove(directory.c_str());
+    return directory;
+}
+
+std::vector<std::string> directory_entries(const std::string & directory)
+{
+    std::vector<std::string> result;
+    DIR * dir = opendir(directory.c_str());
+    if (!dir)
+        return result;
+    while (dirent * d = readdir(dir))
+        if (d->d_name[0] != '.')
+            result.push_back(directory + "/" + d->d_name);
+    closedir(dir);
+    return result;
+}
+
+void remove_directory(const std::string & directory)
+{
+    for (const auto & entry : directory_entries(directory))
+        std::remove(entry.c_str());
+    rmdir(directory.c_str());
+}
+
+#include "compiled_fact.h"
+#include "compiled_fib.h"
+#include "compiled_short_circuit.h"
+
+TEST(driver, run)
+{
+    std::string fact = utils::to_string(testing::compiled_fact);
+    auto compiled_code = [&fact] (const std::vector<int> & input)
+    {
+        return test_compiled(fact, input);
+    };
+    auto run_code = [&fact] (const std::vector<int> & input)
+    {
+        return test_run(fact, input);
+    };
+    EXPECT_EQ_RESULTS(1000, 12, compiled_code, run_code);
+
+    std::string short_circuit = utils::to_string(testing::compiled_short_circuit);
+    std::vector<int> input = {0, 5, 20, -3};
+    std::vector<int> expected_output = {0, 2, 1, 5, 2, 0, 20, 2, 0, -3, 3};
+    EXPECT_EQ(expected_output, test_run(short_circuit, input, lcc::Optimisations::NONE));
+    EXPECT_EQ(expected_output, test_run(short_circuit, input, lcc::Optimisations::AGGRESSIVE));
+}
+
+TEST(driver, cache)
+{
+    std::string directory = temp_directory("test_cache_XXXXXX");
+    {
+        lcc::compile_cache cache(directory, 1000);
+        std::string data;
+        EXPECT_FALSE(cache.lookup("a", data));
+        cache.store("a", std::string(600, 'a'));
+        ASSERT_TRUE(cache.lookup("a", data));
+        EXPECT_EQ(std::string(600, 'a'), data);
+        EXPECT_FALSE(cache.lookup("b", data));
+
+        // Least recently used entry goes once the limit is exceeded
+        utimbuf old_time{0, 0};
+        utime((directory + "/a").c_str(), &old_time);
+        cache.store("b", std::string(600, 'b'));
+        EXPECT_FALSE(cache.lookup("a", data));
+        EXPECT_TRUE(cache.lookup("b", data));
+    }
+    remove_directory(directory);
+
+    // Compilation results are stored once per source and options
+    directory = temp_directory("test_cache_XXXXXX");
+    setenv("LCC_CACHE", "1", 1);
+    setenv("LCC_CACHE_DIR", directory.c_str(), 1);
+    auto compile = [] (const lcc::Options & options)
+    {
+        std::stringstream in(utils::to_string(testing::compiled_fact));
+        std::string ir;
+        llvm::raw_string_ostream out(ir);
+        lcc::compile_llvm(in, out, "test_cache", options);
+        return out.str();
+    };
+    std::string compiled = compile(lcc::Options());
+    EXPECT_EQ(1u, directory_entries(directory).size());
+    EXPECT_EQ(compiled, compile(lcc::Options()));
+    EXPECT_EQ(1u, directory_entries(directory).size());
+    EXPECT_NE(compiled, compile(lcc::Optimisations::NONE));
+    EXPECT_EQ(2u, directory_entries(directory).size());
+    unsetenv("LCC_CACHE");
+    unsetenv("LCC_CACHE_DIR");
+    remove_directory(directory);
+}
+
+TEST(driver, cached_remarks)
+{
+    std::string directory = temp_directory("test_remarks_XXXXXX");
+    setenv("LCC_CACHE", "1", 1);
+    setenv("LCC_CACHE_DIR", directory.c_str(), 1);
+
+    lcc::Options options;
+    options.memoise = true;
+    auto remarks = [&options] ()
+    {
+        lcc::session session(options);
+        std::stringstream in(utils::to_string(testing::compiled_fib));
+        llvm::raw_null_ostream out;
+        session.compile_llvm(in, out, "test_remarks");
+        return session.remarks;
+    };
+    std::vector<std::string> compiled = remarks();
+    EXPECT_FALSE(compiled.empty());
+    EXPECT_EQ(compiled, remarks());
+
+    unsetenv("LCC_CACHE");
+    unsetenv("LCC_CACHE_DIR");
+    remove_directory(directory);
+}
+
+std::string metadata_line(const std::string & ir, const std::string & prefix)
+{
+    std::size_t begin = ir.find(prefix);
+    if (begin == std::string::npos)
+        return "";
+    return ir.substr(begin, ir.find('\n', begin) - begin);
+}
+
+TEST(driver, debug_info)
+{
+    lcc::Options options(lcc::Optimisations::NONE);
+    options.debug_info = true;
+    std::stringstream in(utils::to_string(testing::compiled_fact));
+    std::string ir;
+    llvm::raw_string_ostream out(ir);
+    lcc::compile_llvm(in, out, "fact.lc", options);
+    out.flush();
+
+    // Compile unit is named after the source, functions and statements point to their lines
+    EXPECT_NE("", metadata_line(ir, "!DICompileUnit("));
+    EXPECT_NE("", metadata_line(ir, "!DIFile(filename: \"fact.lc\""));
+    EXPECT_NE(std::string::npos, metadata_line(ir, "!DISubprogram(name: \"main\"").find("line: 3,"));
+    EXPECT_NE(std::string::npos, metadata_line(ir, "!DISubprogram(name: \"fact\"").find("line: 15,"));
+    EXPECT_NE("", metadata_line(ir, "!DILocation(line: 17,"));
+    EXPECT_NE("", metadata_line(ir, "!DILocation(line: 20,"));
+}
+
+std::string replace(std::string text, const std::string & from, const std::string & to)
+{
+    std::size_t position = text.find(from);
+    if (position != std::string::npos)
+        text.replace(position, from.size(), to);
+    return text;
+}
+
+TEST(driver, incremental)
+{
+    std::string directory = temp_directory("test_incremental_XXXXXX");
+    setenv("LCC_CACHE", "1", 1);
+    setenv("LCC_CACHE_DIR", directory.c_str(), 1);
+
+    lcc::Options incremental;
+    incremental.incremental = true;
+    std::string fact = utils::to_string(testing::compiled_fact);
+    std::string edited = replace(fact, "return 1;", "return 2;");
+    std::vector<int> input = {1, 5, 10};
+    std::vector<int> expected = test_compiled(fact, input);
+    EXPECT_EQ(expected, test_compiled(fact, input, incremental));
+
+    // Only fact is generated again, main comes from the cache
+    std::vector<int> expected_edited = test_compiled(edited, input);
+    EXPECT_NE(expected, expected_edited);
+    EXPECT_EQ(expected_edited, test_compiled(edited, input, incremental));
+
+    // Debug information of a moved function is not taken from the cache
+    incremental.debug_info = true;
+    auto compile = [&incremental] (const std::string & code)
+    {
+        std::stringstream in(code);
+        std::string ir;
+        llvm::raw_string_ostream out(ir);
+        lcc::compile_llvm(in, out, "test_incremental", incremental);
+        return out.str();
+    };
+    EXPECT_NE(compile(fact), compile(replace(fact, "int fact(int n)\n{", "\nint fact(int n)\n{")));
+
+    unsetenv("LCC_CACHE");
+    unsetenv("LCC_CACHE_DIR");
+    remove_directory(directory);
+}
+
+lcc::compile_reply request_when_ready(const std::string & socket_path, const std::string & source)
+{
+    for (int attempt = 0; ; ++attempt)
+    {
+        try
+        {
+            return lcc::request_compile(socket_path, source, "test_server", lcc::FileType::LLVM, lcc::Options());
+        }
+        catch (const std::runtime_error &)
+        {
+            // Server is not listening yet
+            if (attempt == 100)
+                throw;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+}
+
+TEST(driver, server)
+{
+    std::string socket_path = lcc::create_temp_file("test_server_XXXXXX");
+    pid_t server = fork();
+    if (server == 0)
+    {
+        lcc::serve(socket_path);
+        _exit(EXIT_FAILURE);
+    }
+
+    lcc::compile_reply reply = request_when_ready(socket_path, utils::to_string(testing::compiled_fact));
+    EXPECT_TRUE(reply.succeeded);
+    EXPECT_NE(std::string::npos, reply.data.find("@main("));
+
+    // Diagnostics are sent back instead of being printed by the server
+    reply = request_when_ready(socket_path, "int main() { return 0 }");
+    EXPECT_FALSE(reply.succeeded);
+    EXPECT_NE(std::string::npos, reply.data.find("syntax error"));
+
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+    unlink(socket_path.c_str());
+}
+
+int main(int argc, char ** argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
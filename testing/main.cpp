@@ -46,6 +46,41 @@ TEST(compiled, fact)
     EXPECT_EQ_RESULTS(10000, 12, compiled_code, expected);
 }
 
+TEST(compiled, file_input)
+{
+    std::string code = utils::to_string(testing::compiled_fact);
+    auto piped_code = [&code] (const std::vector<int> & input)
+    {
+        return test_compiled(code, input);
+    };
+    auto mapped_code = [&code] (const std::vector<int> & input)
+    {
+        return test_compiled_file_input(code, input);
+    };
+
+    // More than the 64 KiB read buffer, the file is mapped as a whole
+    EXPECT_EQ_RESULTS(50000, 12, piped_code, mapped_code);
+    EXPECT_EQ(std::vector<int>{}, test_compiled_file_input(code, {}));
+}
+
+TEST(compiled, binary_io)
+{
+    std::string echo = "int main() { int x; while (read(x)) write(x); return 0; }";
+    std::vector<std::int64_t> values = {0, 1, -1, 1ll << 40, std::numeric_limits<std::int64_t>::min(),
+                                        std::numeric_limits<std::int64_t>::max()};
+    EXPECT_EQ(values, test_compiled_binary(echo, binary_input(values)));
+    EXPECT_EQ(values, test_compiled_binary(echo, binary_input(values), lcc::Optimisations::NONE));
+
+    // A truncated word at the end of input is ignored
+    EXPECT_EQ(values, test_compiled_binary(echo, binary_input(values) + "abc"));
+
+    std::string code = utils::to_string(testing::compiled_fact);
+    std::vector<int> input = random_input(10000, 12);
+    std::vector<int> text_output = test_compiled(code, input);
+    std::vector<std::int64_t> binary_output = test_compiled_binary(code, binary_input({input.begin(), input.end()}));
+    EXPECT_EQ(std::vector<std::int64_t>(text_output.begin(), text_output.end()), binary_output);
+}
+
 #include "compiled_scope.h"
 
 TEST(compiled, scope)
@@ -135,6 +170,26 @@ TEST(compiled, fib)
     EXPECT_EQ_RESULTS(10000, 25, compiled_code, expected);
 }
 
+#include "compiled_short_circuit.h"
+
+TEST(compiled, short_circuit)
+{
+    std::string code = utils::to_string(testing::compiled_short_circuit);
+    std::vector<int> expected_output = {0, 2, 1, 5, 2, 0, 20, 2, 0, -3, 3};
+    EXPECT_EQ(expected_output, test_compiled(code, {0, 5, 20, -3}));
+}
+
+#include "compiled_constants.h"
+
+TEST(compiled, constants)
+{
+    std::string code = utils::to_string(testing::compiled_constants);
+    std::vector<int> input = {3, 20, 7, 5};
+    std::vector<int> expected_output = {18, 6, 120, 24, 14, 30, 11, 0};
+    EXPECT_EQ(expected_output, test_compiled(code, input, lcc::Optimisations::NONE));
+    EXPECT_EQ(expected_output, test_compiled(code, input));
+}
+
 int main(int argc, char ** argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -30,6 +30,26 @@ TEST(optimised, fact)
     EXPECT_EQ_RESULTS(40000, 12, compiled_code, optimised_code);
 }
 
+#include "compiled_fib.h"
+
+TEST(optimised, memoise)
+{
+    std::string code = utils::to_string(testing::compiled_fib);
+    lcc::Options memoise;
+    memoise.memoise = true;
+    auto compiled_code = [&code] (const std::vector<int> & input)
+    {
+        return test_compiled(code, input, lcc::Optimisations::ACC,
+                             "without memoisation");
+    };
+    auto memoised_code = [&code, &memoise] (const std::vector<int> & input)
+    {
+        return test_compiled(code, input, memoise, "with memoisation");
+    };
+
+    EXPECT_EQ_RESULTS(1000, 30, compiled_code, memoised_code);
+}
+
 #include "optimised_stack_overflow.h"
 
 TEST(optimised, stack_overflow)
@@ -41,6 +61,52 @@ TEST(optimised, stack_overflow)
                  testing::killed_by_signal);
 }
 
+#include "optimised_mutual_recursion.h"
+
+TEST(optimised, mutual_recursion)
+{
+    std::string code = utils::to_string(testing::optimised_mutual_recursion);
+    std::vector<int> expected{1, 0};
+    EXPECT_EQ(expected, test_compiled(code, {}, lcc::Optimisations::TCO));
+    EXPECT_EQ(expected, test_compiled(code, {}, lcc::Optimisations::ACC));
+    EXPECT_THROW(test_compiled(code, {}, lcc::Optimisations::NONE),
+                 testing::killed_by_signal);
+}
+
+#include "optimised_inline.h"
+
+TEST(optimised, inline)
+{
+    std::string code = utils::to_string(testing::optimised_inline);
+    auto compiled_code = [&code] (const std::vector<int> & input)
+    {
+        return test_compiled(code, input, lcc::Optimisations::NONE);
+    };
+    auto inlined_code = [&code] (const std::vector<int> & input)
+    {
+        return test_compiled(code, input, lcc::Optimisations::TCO);
+    };
+
+    EXPECT_EQ_RESULTS(1000, 100, compiled_code, inlined_code);
+}
+
+#include "optimised_devirtualise.h"
+
+TEST(optimised, devirtualise)
+{
+    std::string code = utils::to_string(testing::optimised_devirtualise);
+    auto compiled_code = [&code] (const std::vector<int> & input)
+    {
+        return test_compiled(code, input, lcc::Optimisations::NONE);
+    };
+    auto devirtualised_code = [&code] (const std::vector<int> & input)
+    {
+        return test_compiled(code, input, lcc::Optimisations::ACC);
+    };
+
+    EXPECT_EQ_RESULTS(1000, 1000, compiled_code, devirtualised_code);
+}
+
 int main(int argc, char ** argv)
 {
     testing::InitGoogleTest(&argc, argv);
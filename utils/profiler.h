@@ -0,0 +1,193 @@
+#pragma once
+
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace utils
+{
+/*
+ * Collects timings of compiler phases and of finer grained spans,
+ * e.g. code generation of one function. Phases are summarised by
+ * write_report, every event goes to the Chrome trace (chrome://tracing)
+ * written by write_trace. Events can be recorded from several threads.
+ */
+struct profiler
+{
+    using clock = std::chrono::steady_clock;
+
+    enum class kind
+    {
+        PHASE,
+        SPAN
+    };
+
+    struct event
+    {
+        std::string name;
+        kind type;
+        unsigned thread;
+        clock::time_point start;
+        std::chrono::duration<double> wall;
+        double cpu;
+        long peak_rss;
+    };
+
+    /* Records an event from construction to destruction, does nothing without a profiler */
+    struct scope
+    {
+        scope(profiler * owner, std::string name, kind type = kind::PHASE)
+            : owner(owner)
+        {
+            if (!owner)
+                return;
+            current.name = std::move(name);
+            current.type = type;
+            if (type == kind::PHASE)
+            {
+                current.cpu = cpu_seconds();
+                current.peak_rss = peak_rss_kib();
+            }
+            current.start = clock::now();
+        }
+
+        ~scope()
+        {
+            if (!owner)
+                return;
+            current.wall = clock::now() - current.start;
+            if (current.type == kind::PHASE)
+            {
+                current.cpu = cpu_seconds() - current.cpu;
+                current.peak_rss = peak_rss_kib() - current.peak_rss;
+            }
+            owner->record(std::move(current));
+        }
+
+        scope(const scope &) = delete;
+        scope & operator=(const scope &) = delete;
+
+        profiler * owner;
+        event current;
+    };
+
+    profiler()
+        : epoch(clock::now())
+    {}
+
+    void record(event e)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto id = std::this_thread::get_id();
+        auto it = threads.find(id);
+        if (it == threads.end())
+            it = threads.emplace(id, threads.size()).first;
+        e.thread = it->second;
+        events.push_back(std::move(e));
+    }
+
+    /* Wall, CPU and peak RSS growth per phase, summed over all threads */
+    void write_report(std::ostream & out) const
+    {
+        struct total
+        {
+            std::string name;
+            double wall, cpu;
+            long peak_rss;
+        };
+        std::vector<total> totals;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto & e : events)
+        {
+            if (e.type != kind::PHASE)
+                continue;
+            auto it = totals.begin();
+            while (it != totals.end() && it->name != e.name)
+                ++it;
+            if (it == totals.end())
+                it = totals.insert(it, total{e.name, 0, 0, 0});
+            it->wall += e.wall.count();
+            it->cpu += e.cpu;
+            it->peak_rss += e.peak_rss;
+        }
+
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-24s %12s %12s %16s\n", "phase", "wall (s)", "cpu (s)", "peak RSS (KiB)");
+        out << line;
+        for (const auto & t : totals)
+        {
+            std::snprintf(line, sizeof(line), "%-24s %12.6f %12.6f %+16ld\n",
+                          t.name.c_str(), t.wall, t.cpu, t.peak_rss);
+            out << line;
+        }
+        std::snprintf(line, sizeof(line), "%-24s %12s %12s %16ld\n", "peak RSS", "", "", peak_rss_kib());
+        out << line;
+    }
+
+    /* Chrome trace event format, one complete event per phase or span */
+    void write_trace(std::ostream & out) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "{\"traceEvents\":[";
+        bool first = true;
+        for (const auto & e : events)
+        {
+            using microseconds = std::chrono::duration<double, std::micro>;
+            out << (first ? "\n" : ",\n")
+                << "{\"name\":\"" << escape(e.name) << "\""
+                << ",\"cat\":\"" << (e.type == kind::PHASE ? "phase" : "span") << "\""
+                << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+                << ",\"ts\":" << microseconds(e.start - epoch).count()
+                << ",\"dur\":" << microseconds(e.wall).count() << "}";
+            first = false;
+        }
+        out << "\n]}\n";
+    }
+
+    static double cpu_seconds()
+    {
+        rusage usage;
+#ifdef RUSAGE_THREAD
+        getrusage(RUSAGE_THREAD, &usage);
+#else
+        getrusage(RUSAGE_SELF, &usage);
+#endif
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+            + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+
+    static long peak_rss_kib()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    static std::string escape(const std::string & s)
+    {
+        std::string result;
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+                result += '\\';
+            if (static_cast<unsigned char>(c) < 0x20)
+                continue;
+            result += c;
+        }
+        return result;
+    }
+
+    clock::time_point epoch;
+    mutable std::mutex mutex;
+    std::map<std::thread::id, unsigned> threads;
+    std::vector<event> events;
+};
+}